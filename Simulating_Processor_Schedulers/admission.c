@@ -0,0 +1,239 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "simulator.h"
+
+extern __thread struct process *current;
+extern __thread unsigned int ticks;
+
+bool __admission = false;
+
+/**
+ * Admission control with --admit. A process is admitted or rejected when it
+ * is due to fork, before the scheduler hears of it. A rejected process is
+ * dropped without running, as an overloaded server sheds the requests it
+ * cannot serve in time.
+ *
+ *   queue:     Reject when @queue processes are ready already.
+ *   deadline:  Reject when the process would not complete in @deadline ticks
+ *              from now, estimated as the work left in the ready queue and
+ *              in the running process shared by the CPUs plus its lifespan.
+ *   rate:      Admit at most @rate processes per tick on average, and up to
+ *              @burst of them at once. The tokens of the bucket are refilled
+ *              at @rate per tick up to @burst, and each admission takes one.
+ *
+ * The limits are applied in this order, and a process rejected by one does
+ * not take a token.
+ */
+enum {
+	REJECT_QUEUE,
+	REJECT_DEADLINE,
+	REJECT_RATE,
+	NR_REJECTS,
+};
+
+static struct {
+	unsigned int queue;			/* 0 for no limit */
+	unsigned long long deadline;	/* 0 for no limit */
+	double rate;				/* 0 for no limit */
+	double burst;
+
+	double tokens;
+	double refilled_at;			/* Tick the bucket is refilled up to */
+
+	unsigned long long nr_admitted;
+	unsigned long long nr_rejected[NR_REJECTS];
+} __admit_control = {
+	.burst = 1,
+	.tokens = 1,
+};
+
+static const char *__reject_names[NR_REJECTS] = {
+	[REJECT_QUEUE] = "queue",
+	[REJECT_DEADLINE] = "deadline",
+	[REJECT_RATE] = "rate",
+};
+
+/**
+ * Work left in @p if it is running
+ */
+static unsigned long long __running_work(struct process *p)
+{
+	if (!p || p->status != PROCESS_RUNNING)
+		return 0;
+	return p->lifespan - p->age;
+}
+
+/**
+ * Ticks it would take to run the work ahead of a process forked now. With
+ * several CPUs, the processes are forked before the CPUs pick the next ones,
+ * so the running ones are those on the CPUs in the previous tick
+ */
+static unsigned long long __backlog(void)
+{
+	unsigned long long work = __ready_work();
+
+	if (__nr_cpus > 1) {
+		for (unsigned int i = 0; i < __nr_cpus; i++) {
+			work += __running_work(__cpus[i].curr);
+		}
+	} else {
+		work += __running_work(current);
+	}
+	return (work + __nr_cpus - 1) / __nr_cpus;
+}
+
+/**
+ * Take a token from the bucket refilled up to now
+ */
+static bool __take_token(void)
+{
+	double now = __tick_ns ? (double)__now_ns / __tick_ns : ticks;
+
+	__admit_control.tokens += (now - __admit_control.refilled_at) * __admit_control.rate;
+	if (__admit_control.tokens > __admit_control.burst)
+		__admit_control.tokens = __admit_control.burst;
+	__admit_control.refilled_at = now;
+
+	if (__admit_control.tokens < 1)
+		return false;
+	__admit_control.tokens -= 1;
+	return true;
+}
+
+static void __reject(struct process *p, int reason)
+{
+	struct resource_schedule *rs, *rs_tmp;
+	struct io_schedule *io, *io_tmp;
+
+	__admit_control.nr_rejected[reason]++;
+	__log_event(EVENT_REJECTED, p->pid, 0);
+
+	list_for_each_entry_safe(rs, rs_tmp, &p->cold->__resources_to_acquire, list) {
+		list_del(&rs->list);
+		free(rs);
+	}
+	list_for_each_entry_safe(io, io_tmp, &p->cold->__io_to_do, list) {
+		list_del(&io->list);
+		free(io);
+	}
+	__free_process(p);
+}
+
+/**
+ * Admit @p due to fork now, or reject and free it. Returns false if rejected
+ */
+bool __admit(struct process *p)
+{
+	if (__admit_control.queue && __ready_pending() >= __admit_control.queue) {
+		__reject(p, REJECT_QUEUE);
+		return false;
+	}
+	if (__admit_control.deadline &&
+	    __backlog() + p->lifespan > __admit_control.deadline) {
+		__reject(p, REJECT_DEADLINE);
+		return false;
+	}
+	if (__admit_control.rate && !__take_token()) {
+		__reject(p, REJECT_RATE);
+		return false;
+	}
+
+	__admit_control.nr_admitted++;
+	return true;
+}
+
+static bool __parse_limit(const char *key, const char *value)
+{
+	char *end;
+
+	if (!strcmp(key, "queue")) {
+		__admit_control.queue = strtoul(value, &end, 10);
+		return *end == '\0' && __admit_control.queue > 0;
+	} else if (!strcmp(key, "deadline")) {
+		__admit_control.deadline = strtoull(value, &end, 10);
+		return *end == '\0' && __admit_control.deadline > 0;
+	} else if (!strcmp(key, "rate")) {
+		__admit_control.rate = strtod(value, &end);
+		return *end == '\0' && __admit_control.rate > 0;
+	} else if (!strcmp(key, "burst")) {
+		__admit_control.burst = strtod(value, &end);
+		return *end == '\0' && __admit_control.burst >= 1;
+	}
+	return false;
+}
+
+/***********************************************************************
+ * Set up the admission control from @spec
+ *
+ * DESCRIPTION
+ *   @spec is the limits to admit processes such as
+ *   queue=64,deadline=500,rate=0.2,burst=10
+ */
+bool __admission_setup(const char *spec)
+{
+	char buffer[256];
+	char *params = buffer;
+
+	if (strlen(spec) >= sizeof(buffer))
+		goto invalid;
+	strcpy(buffer, spec);
+
+	while (params && *params) {
+		char *param = params;
+		char *value;
+
+		if ((params = strchr(params, ',')))
+			*params++ = '\0';
+		if (!(value = strchr(param, '=')))
+			goto invalid;
+		*value++ = '\0';
+		if (!__parse_limit(param, value))
+			goto invalid;
+	}
+
+	/* The bucket starts full */
+	__admit_control.tokens = __admit_control.burst;
+	__admission = true;
+	return true;
+
+invalid:
+	fprintf(stderr, "Invalid admission limits %s\n", spec);
+	return false;
+}
+
+void __admission_report(void)
+{
+	unsigned long long nr_rejected = 0;
+	unsigned long long nr;
+
+	for (int i = 0; i < NR_REJECTS; i++) {
+		nr_rejected += __admit_control.nr_rejected[i];
+	}
+	nr = __admit_control.nr_admitted + nr_rejected;
+
+	printf("\nAdmitted %llu of %llu processes (%.1f%%), rejected %llu\n",
+	       __admit_control.nr_admitted, nr,
+	       nr ? __admit_control.nr_admitted * 100.0 / nr : 0.0, nr_rejected);
+	for (int i = 0; i < NR_REJECTS; i++) {
+		if (__admit_control.nr_rejected[i])
+			printf("  %-8s %llu\n", __reject_names[i], __admit_control.nr_rejected[i]);
+	}
+}
@@ -0,0 +1,229 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "simulator.h"
+
+extern bool quiet;
+
+struct process *(*__stream_next)(void) = NULL;
+
+/**
+ * Open-loop arrivals generated from a distribution.
+ *
+ *   poisson:  Processes arrive with exponential inter-arrival times of mean
+ *             1 / @rate ticks.
+ *   onoff:    Same as poisson during the on periods, and nothing arrives
+ *             during the off periods. The lengths of the periods are
+ *             exponentially distributed with mean @on and @off ticks.
+ *
+ * Lifespans are exponentially distributed with mean @lifespan (at least 1),
+ * and priorities are uniformly distributed in [@prio_min, @prio_max], so are
+ * the working sets in [@ws_min, @ws_max] KB.
+ * Processes are numbered from 0, wrapped around at @pids if it is not 0 to
+ * keep the event log narrow.
+ */
+static struct {
+	enum {
+		ARRIVAL_POISSON,
+		ARRIVAL_ONOFF,
+	} type;
+	double rate;
+	double on;
+	double off;
+	double lifespan;
+	unsigned int prio_min;
+	unsigned int prio_max;
+	unsigned int ws_min;
+	unsigned int ws_max;
+	unsigned long long count;
+	unsigned int pids;
+
+	unsigned long long rng;		/* State of the random number generator */
+	double now;					/* When the last process arrived */
+	double on_until;			/* End of the current on period */
+	unsigned long long nr_generated;
+} __arrival = {
+	.rate = 0.1,
+	.on = 100,
+	.off = 100,
+	.lifespan = 5,
+	.count = 1000,
+	.rng = 1,
+};
+
+/**
+ * splitmix64. Deterministic for a given seed on every platform
+ */
+static unsigned long long __random(void)
+{
+	unsigned long long z = (__arrival.rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Exponentially distributed with @mean
+ */
+static double __exponential(double mean)
+{
+	/* Uniform in (0, 1] */
+	double u = ((__random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+	return -log(u) * mean;
+}
+
+static struct process *__arrival_next(void)
+{
+	struct process *p;
+	double gap;
+
+	if (__arrival.nr_generated == __arrival.count)
+		return NULL;
+
+	gap = __exponential(1 / __arrival.rate);
+	if (__arrival.type == ARRIVAL_ONOFF) {
+		/* Carry the rest of the gap over the off periods */
+		while (__arrival.now + gap > __arrival.on_until) {
+			gap -= __arrival.on_until - __arrival.now;
+			__arrival.now = __arrival.on_until + __exponential(__arrival.off);
+			__arrival.on_until = __arrival.now + __exponential(__arrival.on);
+		}
+	}
+	__arrival.now += gap;
+
+	p = __alloc_process();
+	p->pid = __arrival.pids ? __arrival.nr_generated % __arrival.pids : __arrival.nr_generated;
+	p->lifespan = 1 + (unsigned int)__exponential(__arrival.lifespan - 1);
+	p->prio = p->prio_orig = __arrival.prio_min +
+		__random() % (__arrival.prio_max - __arrival.prio_min + 1);
+	p->cold->__starts_at = __arrival.now;
+	p->cold->__working_set = __arrival.ws_min;
+	if (__arrival.ws_max > __arrival.ws_min)
+		p->cold->__working_set += __random() % (__arrival.ws_max - __arrival.ws_min + 1);
+
+	__arrival.nr_generated++;
+	return p;
+}
+
+/**
+ * Parse @value of @key in the generator specification
+ */
+static bool __parse_param(const char *key, const char *value)
+{
+	char *end;
+
+	if (!strcmp(key, "rate")) {
+		__arrival.rate = strtod(value, &end);
+		return *end == '\0' && __arrival.rate > 0;
+	} else if (!strcmp(key, "on")) {
+		__arrival.on = strtod(value, &end);
+		return *end == '\0' && __arrival.on > 0;
+	} else if (!strcmp(key, "off")) {
+		__arrival.off = strtod(value, &end);
+		return *end == '\0' && __arrival.off >= 0;
+	} else if (!strcmp(key, "lifespan")) {
+		__arrival.lifespan = strtod(value, &end);
+		return *end == '\0' && __arrival.lifespan >= 1;
+	} else if (!strcmp(key, "prio")) {
+		__arrival.prio_min = __arrival.prio_max = strtoul(value, &end, 10);
+		if (*end == '-')
+			__arrival.prio_max = strtoul(end + 1, &end, 10);
+		return *end == '\0' && __arrival.prio_min <= __arrival.prio_max &&
+			__arrival.prio_max <= MAX_PRIO;
+	} else if (!strcmp(key, "workingset")) {
+		__arrival.ws_min = __arrival.ws_max = strtoul(value, &end, 10);
+		if (*end == '-')
+			__arrival.ws_max = strtoul(end + 1, &end, 10);
+		return *end == '\0' && __arrival.ws_min <= __arrival.ws_max;
+	} else if (!strcmp(key, "count")) {
+		__arrival.count = strtoull(value, &end, 10);
+		return *end == '\0';
+	} else if (!strcmp(key, "seed")) {
+		__arrival.rng = strtoull(value, &end, 10);
+		return *end == '\0';
+	} else if (!strcmp(key, "pids")) {
+		__arrival.pids = strtoul(value, &end, 10);
+		return *end == '\0';
+	}
+	return false;
+}
+
+/***********************************************************************
+ * Generate processes from @spec in the streaming mode
+ *
+ * DESCRIPTION
+ *   @spec is the type of the arrivals followed by the parameters such as
+ *   poisson:rate=0.2,lifespan=10,prio=0-8,count=100000,seed=7
+ *   onoff:rate=1,on=50,off=200,count=100000
+ */
+bool __stream_generate(const char *spec)
+{
+	char buffer[256];
+	char *params = NULL;
+	char *param;
+
+	if (strlen(spec) >= sizeof(buffer))
+		goto invalid;
+	strcpy(buffer, spec);
+
+	if ((params = strchr(buffer, ':')))
+		*params++ = '\0';
+
+	if (!strcmp(buffer, "poisson")) {
+		__arrival.type = ARRIVAL_POISSON;
+	} else if (!strcmp(buffer, "onoff")) {
+		__arrival.type = ARRIVAL_ONOFF;
+	} else {
+		goto invalid;
+	}
+
+	while (params && *params) {
+		char *value;
+
+		param = params;
+		if ((params = strchr(params, ',')))
+			*params++ = '\0';
+		if (!(value = strchr(param, '=')))
+			goto invalid;
+		*value++ = '\0';
+		if (!__parse_param(param, value))
+			goto invalid;
+	}
+
+	__arrival.on_until = __exponential(__arrival.on);
+	__stream_next = __arrival_next;
+
+	if (!quiet) {
+		printf("Generating %llu processes arriving %s at %g per tick", __arrival.count,
+		       __arrival.type == ARRIVAL_POISSON ? "in Poisson" : "in on/off bursts",
+		       __arrival.rate);
+		if (__arrival.type == ARRIVAL_ONOFF)
+			printf(" (on %g, off %g ticks)", __arrival.on, __arrival.off);
+		printf("\n\n");
+	}
+	return true;
+
+invalid:
+	fprintf(stderr, "Invalid arrivals %s\n", spec);
+	return false;
+}
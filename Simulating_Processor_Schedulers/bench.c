@@ -0,0 +1,129 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * Benchmark of the pick-next over the ready queue. Compares walking the list
+ * as the schedulers used to do against the kernels scanning the packed keys
+ * of the ready set. Build with make bench and run ./bench.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "simulator.h"
+
+__thread struct list_head readyqueue;
+__thread unsigned int ticks = 0;
+__thread struct process *current = NULL;
+
+static struct process *__list_highest_prio(void)
+{
+	struct process *next = list_first_entry(&readyqueue, struct process, list);
+	struct process *test;
+	unsigned int highest = next->prio;
+
+	list_for_each_entry(test, &readyqueue, list) {
+		if (test->prio > highest) {
+			next = test;
+			highest = next->prio;
+		}
+	}
+	return next;
+}
+
+typedef unsigned int (*argbest_fn)(const unsigned int *, const unsigned int *,
+				   unsigned int, unsigned int);
+
+static double __elapsed(clock_t start, unsigned int nr, unsigned int rounds)
+{
+	/* Nanoseconds per element */
+	return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / nr / rounds;
+}
+
+int main(int argc, char * const argv[])
+{
+	const struct {
+		const char *name;
+		argbest_fn fn;
+	} kernels[] = {
+		{ "scalar", __ready_argbest_scalar },
+		{ "sse4.1", __ready_argbest_sse41 },
+		{ "avx2", __ready_argbest_avx2 },
+	};
+
+	printf("%10s %10s", "# ready", "list");
+	for (unsigned int k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+		printf(" %10s", kernels[k].name);
+	}
+	printf("   (ns per process)\n");
+
+	for (unsigned int nr = 1000; nr <= 1000000; nr *= 10) {
+		struct process *procs = calloc(nr, sizeof(*procs));
+		unsigned int *order = malloc(sizeof(*order) * nr);
+		unsigned int *prio = malloc(sizeof(*prio) * nr);
+		unsigned int *seq = malloc(sizeof(*seq) * nr);
+		unsigned int rounds = 100000000 / nr;
+		struct process *expected;
+		unsigned int sink = 0;
+		clock_t start;
+
+		/* Link the processes in a random order as they are forked and woken up */
+		for (unsigned int i = 0; i < nr; i++) {
+			order[i] = i;
+		}
+		for (unsigned int i = nr - 1; i > 0; i--) {
+			unsigned int j = rand() % (i + 1);
+			unsigned int tmp = order[i];
+			order[i] = order[j];
+			order[j] = tmp;
+		}
+		INIT_LIST_HEAD(&readyqueue);
+		for (unsigned int i = 0; i < nr; i++) {
+			struct process *p = procs + order[i];
+
+			p->prio = rand() % MAX_PRIO;
+			list_add_tail(&p->list, &readyqueue);
+			prio[order[i]] = p->prio;
+			seq[order[i]] = i;
+		}
+
+		expected = __list_highest_prio();
+		start = clock();
+		for (unsigned int r = 0; r < rounds; r++) {
+			sink += __list_highest_prio()->prio;
+		}
+		printf("%10u %10.3f", nr, __elapsed(start, nr, rounds));
+
+		for (unsigned int k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+			if (procs + kernels[k].fn(prio, seq, nr, 0) != expected) {
+				fprintf(stderr, "\n%s picked a wrong process\n", kernels[k].name);
+				return EXIT_FAILURE;
+			}
+			start = clock();
+			for (unsigned int r = 0; r < rounds; r++) {
+				sink += kernels[k].fn(prio, seq, nr, 0);
+			}
+			printf(" %10.3f", __elapsed(start, nr, rounds));
+		}
+		printf("%s\n", sink ? "" : " ");
+
+		free(procs);
+		free(order);
+		free(prio);
+		free(seq);
+	}
+
+	return EXIT_SUCCESS;
+}
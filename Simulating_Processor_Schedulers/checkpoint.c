@@ -0,0 +1,531 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "simulator.h"
+#include "ready.h"
+
+extern __thread struct process *current;
+extern __thread struct list_head readyqueue;
+extern struct resource resources[NR_RESOURCES];
+extern __thread unsigned int ticks;
+
+/**
+ * A checkpoint is a stream of unsigned LEB128 integers following the magic.
+ *
+ *   version, ticks, length and name of the scheduler, statistics,
+ *   contention profile of the resources, ticks run per priority,
+ *   # of groups with (length and name, weight, virtual time, ticks run,
+ *   ticks entitled) of each, virtual time of the groups,
+ *   # of processes, process records, # of ready, # of pending forks,
+ *   (ceiling, capacity, shared, # of owners, owner + 1 of each, # of
+ *   waiters) for each resource, # of processes in I/O with (completion
+ *   tick, sequence) of each, and current + 1.
+ *
+ * Processes are recorded in the order of the ready queue, the fork queue,
+ * the waitqueue of each resource, the timing wheel, and current unless it
+ * is in one of them, so the queues are rebuilt just from their lengths.
+ * Owners and current refer to the process records by index (0 for none).
+ */
+#define NR_STATS	(sizeof(struct __stats) / sizeof(unsigned long long))
+#define NR_CONTENTION	(NR_RESOURCES * sizeof(struct __contention) / sizeof(unsigned long long))
+#define NR_INVERSION	(sizeof(struct __inversion) / sizeof(unsigned long long))
+
+#define CHECKPOINT_MAGIC	"SCHEDCKP"
+#define CHECKPOINT_VERSION	9
+
+static void __put(FILE *file, unsigned long long v)
+{
+	do {
+		unsigned char byte = v & 0x7f;
+
+		v >>= 7;
+		fputc(byte | (v ? 0x80 : 0), file);
+	} while (v);
+}
+
+static bool __get(FILE *file, unsigned long long *v)
+{
+	int shift = 0;
+	int byte;
+
+	*v = 0;
+	do {
+		if ((byte = fgetc(file)) == EOF || shift > 63)
+			return false;
+		*v |= (unsigned long long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return true;
+}
+
+static void __put_schedules(FILE *file, struct list_head *head)
+{
+	struct resource_schedule *rs;
+	unsigned int nr = 0;
+
+	list_for_each_entry(rs, head, list) {
+		nr++;
+	}
+	__put(file, nr);
+
+	list_for_each_entry(rs, head, list) {
+		__put(file, rs->resource_id);
+		__put(file, rs->at);
+		__put(file, rs->duration);
+		__put(file, rs->shared);
+		__put(file, rs->acquired_at);
+	}
+}
+
+static void __put_ios(FILE *file, struct list_head *head)
+{
+	struct io_schedule *io;
+	unsigned int nr = 0;
+
+	list_for_each_entry(io, head, list) {
+		nr++;
+	}
+	__put(file, nr);
+
+	list_for_each_entry(io, head, list) {
+		__put(file, io->at);
+		__put(file, io->duration);
+	}
+}
+
+static void __put_process(FILE *file, struct process *p)
+{
+	__put(file, p->pid);
+	__put(file, p->status);
+	__put(file, p->age);
+	__put(file, p->lifespan);
+	__put(file, p->prio);
+	__put(file, p->prio_orig);
+	__put(file, p->cold->__starts_at);
+	__put(file, p->cold->waiting_for ? p->cold->waiting_for - resources + 1 : 0);
+	__put(file, p->cold->wants_shared);
+	__put(file, p->cold->__nr_dispatches);
+	__put(file, p->cold->__io_ticks);
+	__put(file, p->cold->__blocked_at);
+	__put(file, p->cold->__inversion_mark[0]);
+	__put(file, p->cold->__inversion_mark[1]);
+	__put(file, p->cold->__inversion[0]);
+	__put(file, p->cold->__inversion[1]);
+	__put(file, p->cold->__ready_at);
+	__put(file, p->cold->__nr_starved);
+	__put(file, p->cold->__group);
+	__put(file, p->cold->__woken_at);
+	__put_schedules(file, &p->cold->__resources_to_acquire);
+	__put_schedules(file, &p->cold->__resources_holding);
+	__put_ios(file, &p->cold->__io_to_do);
+}
+
+struct __process_array {
+	struct process **p;
+	unsigned int nr;
+	unsigned int size;
+};
+
+static void __append(struct __process_array *a, struct process *p)
+{
+	if (a->nr == a->size) {
+		a->size = a->size ? a->size * 2 : 64;
+		a->p = realloc(a->p, sizeof(*a->p) * a->size);
+		assert(a->p);
+	}
+	a->p[a->nr++] = p;
+}
+
+static unsigned int __index_of(struct __process_array *a, struct process *p)
+{
+	/* Only used for a few processes. Just look them up */
+	for (unsigned int i = 0; p && i < a->nr; i++) {
+		if (a->p[i] == p)
+			return i + 1;
+	}
+	return 0;
+}
+
+static unsigned int __append_list(struct __process_array *a, struct list_head *head)
+{
+	struct process *p;
+	unsigned int nr = 0;
+
+	list_for_each_entry(p, head, list) {
+		__append(a, p);
+		nr++;
+	}
+	return nr;
+}
+
+static void __append_each(struct process *p, void *data)
+{
+	__append(data, p);
+}
+
+/***********************************************************************
+ * Save the simulator state at the beginning of the current tick
+ */
+bool __checkpoint_save(const char *filename)
+{
+	struct __process_array procs = { 0 };
+	unsigned int nr_ready, nr_forks, io_from, nr_io;
+	unsigned int nr_waiters[NR_RESOURCES];
+	FILE *file;
+
+	if (!(file = fopen(filename, "wb"))) {
+		perror(filename);
+		return false;
+	}
+
+	__ready_for_each(__append_each, &procs);
+	nr_ready = procs.nr;
+	nr_forks = __append_list(&procs, &__forkqueue);
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		nr_waiters[i] = __append_list(&procs, &resources[i].waitqueue);
+	}
+	io_from = procs.nr;
+	__timer_for_each(__append_each, &procs);
+	nr_io = procs.nr - io_from;
+	if (current && list_empty(&current->list))
+		__append(&procs, current);
+
+	fwrite(CHECKPOINT_MAGIC, 1, strlen(CHECKPOINT_MAGIC), file);
+	__put(file, CHECKPOINT_VERSION);
+	__put(file, ticks);
+	__put(file, strlen(sched->name));
+	fwrite(sched->name, 1, strlen(sched->name), file);
+	for (unsigned int i = 0; i < NR_STATS; i++) {
+		__put(file, ((unsigned long long *)&__stats)[i]);
+	}
+	for (unsigned int i = 0; i < NR_CONTENTION; i++) {
+		__put(file, ((unsigned long long *)__contention)[i]);
+	}
+	for (unsigned int i = 0; i < NR_INVERSION; i++) {
+		__put(file, ((unsigned long long *)&__inversion)[i]);
+	}
+	__put(file, __nr_groups);
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		struct __group *g = __groups + i;
+
+		__put(file, strlen(g->name));
+		fwrite(g->name, 1, strlen(g->name), file);
+		__put(file, g->weight);
+		__put(file, g->vruntime);
+		__put(file, g->ran);
+		__put(file, g->entitled);
+	}
+	__put(file, __group_min_vruntime);
+
+	__put(file, procs.nr);
+	for (unsigned int i = 0; i < procs.nr; i++) {
+		__put_process(file, procs.p[i]);
+	}
+
+	__put(file, nr_ready);
+	__put(file, nr_forks);
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		struct resource *r = resources + i;
+
+		__put(file, r->ceiling);
+		__put(file, r->capacity);
+		__put(file, r->shared);
+		__put(file, r->nr_owners);
+		for (unsigned int j = 0; j < r->nr_owners; j++) {
+			__put(file, __index_of(&procs, r->owners[j]));
+		}
+		__put(file, nr_waiters[i]);
+	}
+	__put(file, nr_io);
+	for (unsigned int i = io_from; i < io_from + nr_io; i++) {
+		__put(file, procs.p[i]->cold->__io_until);
+		__put(file, procs.p[i]->cold->__io_seq);
+	}
+	__put(file, __index_of(&procs, current));
+
+	free(procs.p);
+	return fclose(file) == 0;
+}
+
+static bool __get_schedules(FILE *file, struct list_head *head)
+{
+	unsigned long long nr;
+
+	if (!__get(file, &nr))
+		return false;
+
+	while (nr--) {
+		unsigned long long id, at, duration, shared, acquired_at;
+		struct resource_schedule *rs;
+
+		if (!__get(file, &id) || !__get(file, &at) || !__get(file, &duration) ||
+		    !__get(file, &shared) || !__get(file, &acquired_at) || id >= NR_RESOURCES)
+			return false;
+
+		rs = malloc(sizeof(*rs));
+		*rs = (struct resource_schedule) {
+			.resource_id = id,
+			.at = at,
+			.duration = duration,
+			.shared = shared,
+			.acquired_at = acquired_at,
+		};
+		list_add_tail(&rs->list, head);
+	}
+	return true;
+}
+
+static bool __get_ios(FILE *file, struct list_head *head)
+{
+	unsigned long long nr;
+
+	if (!__get(file, &nr))
+		return false;
+
+	while (nr--) {
+		unsigned long long at, duration;
+		struct io_schedule *io;
+
+		if (!__get(file, &at) || !__get(file, &duration))
+			return false;
+
+		io = malloc(sizeof(*io));
+		*io = (struct io_schedule) {
+			.at = at,
+			.duration = duration,
+		};
+		list_add_tail(&io->list, head);
+	}
+	return true;
+}
+
+/**
+ * The ready processes are put back into the ready queue of the default group,
+ * and the scheduler puts them into their groups again as it initializes
+ */
+static bool __get_groups(FILE *file)
+{
+	unsigned long long nr;
+
+	if (!__get(file, &nr) || !nr || nr > MAX_GROUPS)
+		return false;
+
+	for (unsigned int i = 0; i < nr; i++) {
+		struct __group *g = __groups + i;
+		unsigned long long len, weight;
+
+		if (!__get(file, &len) || len >= GROUP_NAME_LEN ||
+		    fread(g->name, 1, len, file) != len ||
+		    !__get(file, &weight) || !weight || weight > GROUP_MAX_WEIGHT ||
+		    !__get(file, &g->vruntime) || !__get(file, &g->ran) || !__get(file, &g->entitled))
+			return false;
+		g->name[len] = '\0';
+		g->weight = weight;
+	}
+	__nr_groups = nr;
+
+	return __get(file, &__group_min_vruntime);
+}
+
+static struct process *__get_process(FILE *file)
+{
+	unsigned long long v[20];
+	struct process *p;
+
+	for (int i = 0; i < 20; i++) {
+		if (!__get(file, v + i))
+			return NULL;
+	}
+	if (v[1] > PROCESS_EXIT || v[4] > MAX_PRIO || v[5] > MAX_PRIO || v[7] > NR_RESOURCES ||
+	    v[18] >= __nr_groups)
+		return NULL;
+
+	p = __alloc_process();
+	p->pid = v[0];
+	p->status = v[1];
+	p->age = v[2];
+	p->lifespan = v[3];
+	p->prio = v[4];
+	p->prio_orig = v[5];
+	p->cold->__starts_at = v[6];
+	p->cold->waiting_for = v[7] ? resources + v[7] - 1 : NULL;
+	p->cold->wants_shared = v[8];
+	p->cold->__nr_dispatches = v[9];
+	p->cold->__io_ticks = v[10];
+	p->cold->__blocked_at = v[11];
+	p->cold->__inversion_mark[0] = v[12];
+	p->cold->__inversion_mark[1] = v[13];
+	p->cold->__inversion[0] = v[14];
+	p->cold->__inversion[1] = v[15];
+	p->cold->__ready_at = v[16];
+	p->cold->__nr_starved = v[17];
+	p->cold->__group = v[18];
+	p->cold->__woken_at = v[19];
+
+	if (!__get_schedules(file, &p->cold->__resources_to_acquire) ||
+	    !__get_schedules(file, &p->cold->__resources_holding) ||
+	    !__get_ios(file, &p->cold->__io_to_do))
+		return NULL;
+
+	return p;
+}
+
+static bool __move_processes(struct process **procs, unsigned long long nr_procs,
+			     unsigned long long *next, unsigned long long nr,
+			     struct list_head *head)
+{
+	if (*next + nr > nr_procs)
+		return false;
+
+	for (unsigned long long i = 0; i < nr; i++) {
+		struct process *p = procs[(*next)++];
+
+		if (head == &readyqueue) {
+			unsigned int ready_at = p->cold->__ready_at;
+
+			ready_enqueue(p);
+			p->cold->__ready_at = ready_at;
+		} else {
+			list_add_tail(&p->list, head);
+		}
+	}
+	return true;
+}
+
+/***********************************************************************
+ * Restore the simulator state from a checkpoint saved by __checkpoint_save()
+ *
+ * When resumed with another scheduler, the priorities are reset to the
+ * original ones. In any case, the state private to the scheduler (e.g.,
+ * donations in PIP) is rebuilt by its initialize().
+ */
+bool __checkpoint_restore(const char *filename)
+{
+	char magic[sizeof(CHECKPOINT_MAGIC)] = { 0 };
+	char name[128] = { 0 };
+	unsigned long long version, at, len, nr_procs, nr, next = 0;
+	struct process **procs = NULL;
+	bool same_sched;
+	FILE *file;
+
+	if (!(file = fopen(filename, "rb"))) {
+		perror(filename);
+		return false;
+	}
+
+	if (fread(magic, 1, strlen(CHECKPOINT_MAGIC), file) != strlen(CHECKPOINT_MAGIC) ||
+	    strcmp(magic, CHECKPOINT_MAGIC) ||
+	    !__get(file, &version) || version != CHECKPOINT_VERSION ||
+	    !__get(file, &at) || !__get(file, &len) || len >= sizeof(name) ||
+	    fread(name, 1, len, file) != len) {
+		goto corrupted;
+	}
+	for (unsigned int i = 0; i < NR_STATS; i++) {
+		if (!__get(file, (unsigned long long *)&__stats + i))
+			goto corrupted;
+	}
+	for (unsigned int i = 0; i < NR_CONTENTION; i++) {
+		if (!__get(file, (unsigned long long *)__contention + i))
+			goto corrupted;
+	}
+	for (unsigned int i = 0; i < NR_INVERSION; i++) {
+		if (!__get(file, (unsigned long long *)&__inversion + i))
+			goto corrupted;
+	}
+	if (!__get_groups(file) || !__get(file, &nr_procs))
+		goto corrupted;
+	same_sched = strcmp(name, sched->name) == 0;
+
+	procs = calloc(nr_procs ? nr_procs : 1, sizeof(*procs));
+	for (unsigned long long i = 0; i < nr_procs; i++) {
+		if (!(procs[i] = __get_process(file)))
+			goto corrupted;
+		if (!same_sched)
+			procs[i]->prio = procs[i]->prio_orig;
+	}
+
+	if (!__get(file, &nr) || !__move_processes(procs, nr_procs, &next, nr, &readyqueue))
+		goto corrupted;
+	if (!__get(file, &nr) || !__move_processes(procs, nr_procs, &next, nr, &__forkqueue))
+		goto corrupted;
+
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		struct resource *r = resources + i;
+		unsigned long long ceiling, capacity, shared, owner;
+		struct process *p;
+
+		if (!__get(file, &ceiling) || !__get(file, &capacity) || !capacity ||
+		    !__get(file, &shared) || !__get(file, &nr))
+			goto corrupted;
+
+		r->ceiling = ceiling;
+		r->capacity = capacity;
+		while (nr--) {
+			if (!__get(file, &owner) || !owner || owner > nr_procs ||
+			    !resource_available(r, shared))
+				goto corrupted;
+			resource_get(r, procs[owner - 1], shared);
+		}
+
+		if (!__get(file, &nr) ||
+		    !__move_processes(procs, nr_procs, &next, nr, &r->waitqueue))
+			goto corrupted;
+
+		/* Some schedulers do not track what the waiters are waiting for */
+		list_for_each_entry(p, &r->waitqueue, list) {
+			if (!p->cold->waiting_for)
+				p->cold->waiting_for = r;
+		}
+	}
+
+	__timer_init(at);
+	if (!__get(file, &nr) || next + nr > nr_procs)
+		goto corrupted;
+	while (nr--) {
+		unsigned long long until, seq;
+
+		if (!__get(file, &until) || !__get(file, &seq) || until < at)
+			goto corrupted;
+		__timer_restore(procs[next++], until, seq);
+	}
+
+	if (!__get(file, &nr) || nr > nr_procs)
+		goto corrupted;
+	current = nr ? procs[nr - 1] : NULL;
+	if (current && list_empty(&current->list))
+		next++;
+
+	if (next != nr_procs)
+		goto corrupted;
+
+	ticks = at;
+
+	free(procs);
+	fclose(file);
+	return true;
+
+corrupted:
+	fprintf(stderr, "Corrupted checkpoint %s\n", filename);
+	free(procs);
+	fclose(file);
+	return false;
+}
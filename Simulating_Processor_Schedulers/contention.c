@@ -0,0 +1,145 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simulator.h"
+
+extern __thread unsigned int ticks;
+
+bool __report_contention = false;
+
+/**
+ * Contention profile of each resource. Updated with a handful of additions
+ * on every acquisition and release, so it is always collected
+ */
+struct __contention __contention[NR_RESOURCES] = { 0 };
+
+/**
+ * Bucket n holds the values in [2^(n-1), 2^n), and bucket 0 holds 0
+ */
+static unsigned int __bucket(unsigned int v)
+{
+	return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/**
+ * @p failed to acquire @rs. Retries after being woken up are not counted
+ * again as the wait time is measured from the first attempt
+ */
+void __contention_blocked(struct process *p, struct resource_schedule *rs)
+{
+	struct __contention *c = __contention + rs->resource_id;
+
+	if (p->cold->__blocked_at)
+		return;
+
+	p->cold->__blocked_at = ticks + 1;
+	if (++c->nr_waiters > c->peak_waiters)
+		c->peak_waiters = c->nr_waiters;
+}
+
+void __contention_acquired(struct process *p, struct resource_schedule *rs)
+{
+	struct __contention *c = __contention + rs->resource_id;
+
+	c->nr_acquired++;
+	rs->acquired_at = ticks;
+
+	if (p->cold->__blocked_at) {
+		unsigned int wait = ticks - (p->cold->__blocked_at - 1);
+
+		c->nr_contended++;
+		c->nr_waiters--;
+		c->wait_total += wait;
+		if (c->wait_max < wait)
+			c->wait_max = wait;
+		c->wait_hist[__bucket(wait)]++;
+
+		p->cold->__blocked_at = 0;
+	}
+}
+
+/**
+ * @rs is released at the end of the current tick, so a resource acquired and
+ * released in the same tick is held for a tick
+ */
+void __contention_released(struct resource_schedule *rs)
+{
+	struct __contention *c = __contention + rs->resource_id;
+	unsigned int hold = ticks - rs->acquired_at + 1;
+
+	c->hold_total += hold;
+	if (c->hold_max < hold)
+		c->hold_max = hold;
+	c->hold_hist[__bucket(hold)]++;
+}
+
+static void __print_histogram(const char *name, const unsigned long long *hist)
+{
+	printf("    %s:", name);
+	for (unsigned int i = 0; i < CONTENTION_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		if (i <= 1) {
+			printf(" %u:%llu", i, hist[i]);
+		} else {
+			printf(" %u-%u:%llu", 1U << (i - 1), (unsigned int)((1ULL << i) - 1), hist[i]);
+		}
+	}
+	printf("\n");
+}
+
+static int __compare_contention(const void *a, const void *b)
+{
+	const struct __contention *ca = __contention + *(const int *)a;
+	const struct __contention *cb = __contention + *(const int *)b;
+
+	if (ca->wait_total != cb->wait_total)
+		return ca->wait_total < cb->wait_total ? 1 : -1;
+	if (ca->nr_contended != cb->nr_contended)
+		return ca->nr_contended < cb->nr_contended ? 1 : -1;
+	return *(const int *)a - *(const int *)b;
+}
+
+/***********************************************************************
+ * Report the contention of the resources, the most waited-for first
+ */
+void __contention_report(void)
+{
+	int order[NR_RESOURCES];
+	int nr = 0;
+
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		if (__contention[i].nr_acquired || __contention[i].nr_waiters)
+			order[nr++] = i;
+	}
+	qsort(order, nr, sizeof(*order), __compare_contention);
+
+	printf("\nResource contention\n");
+	printf("%-8s %10s %10s %12s %10s %12s %10s %8s\n", "Resource", "Acquired", "Contended",
+	       "Wait total", "Wait max", "Hold total", "Hold max", "Peak Q");
+	for (int i = 0; i < nr; i++) {
+		struct __contention *c = __contention + order[i];
+
+		printf("[%2d]     %10llu %10llu %12llu %10llu %12llu %10llu %8llu\n", order[i],
+		       c->nr_acquired, c->nr_contended, c->wait_total, c->wait_max,
+		       c->hold_total, c->hold_max, c->peak_waiters);
+		if (c->nr_contended)
+			__print_histogram("wait", c->wait_hist);
+		__print_histogram("hold", c->hold_hist);
+	}
+}
@@ -0,0 +1,467 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "simulator.h"
+#include "ready.h"
+
+extern __thread struct process *current;
+extern __thread unsigned int ticks;
+
+unsigned long long __tick_ns = 0;
+unsigned long long __switch_ns = 0;
+unsigned long long __now_ns = 0;
+
+/**
+ * Simulation in continuous time with --tick-ns.
+ *
+ * The clock counts nanoseconds, and a tick is @__tick_ns of them. Instead of
+ * going through every tick, the clock jumps from one event to the next. The
+ * forks and the completions of I/O are the events in @heap, ordered by the
+ * time and then by the order they were queued. The running process runs up
+ * to the earliest of the next event, the end of the tick, and the points in
+ * its own lifetime to acquire or release resources, to start I/O, or to exit.
+ * It goes on through the points of its own until it blocks or exits, and the
+ * scheduler is asked for the next process at the events and at the ends of
+ * the ticks. So the ticks are still the quanta of the policies, while the
+ * processes run for any number of nanoseconds in between, and idle periods
+ * cost nothing.
+ *
+ * Each dispatch of a process costs @__switch_ns, during which the process is
+ * on the CPU without making a progress.
+ *
+ * @ticks follows the tick the clock is in, so that the policies and the
+ * statistics on the tick such as the contention of resources keep working at
+ * the resolution of a tick. @age and @lifespan of the processes are in ticks
+ * for the policies to compare, and the exact ones are kept in the cold part.
+ */
+struct __ns_event {
+	unsigned long long at;
+	unsigned long long seq;
+	struct process *p;
+	bool fork;				/* Otherwise, the completion of I/O */
+};
+
+static unsigned long long __switched_ns = 0;
+
+static struct {
+	struct __ns_event *events;
+	unsigned int nr;
+	unsigned int size;
+	unsigned int nr_io;		/* # of the completions of I/O */
+	unsigned long long next_seq;
+} __heap;
+
+static bool __before(const struct __ns_event *a, const struct __ns_event *b)
+{
+	return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+static void __heap_push(struct process *p, unsigned long long at, bool fork)
+{
+	struct __ns_event e = { at, __heap.next_seq++, p, fork };
+	unsigned int i;
+
+	if (__heap.nr == __heap.size) {
+		__heap.size = __heap.size ? __heap.size * 2 : 64;
+		__heap.events = realloc(__heap.events, sizeof(*__heap.events) * __heap.size);
+		assert(__heap.events);
+	}
+
+	for (i = __heap.nr++; i; i = (i - 1) / 2) {
+		if (!__before(&e, __heap.events + (i - 1) / 2))
+			break;
+		__heap.events[i] = __heap.events[(i - 1) / 2];
+	}
+	__heap.events[i] = e;
+}
+
+static struct __ns_event __heap_pop(void)
+{
+	struct __ns_event top = __heap.events[0];
+	struct __ns_event last = __heap.events[--__heap.nr];
+	unsigned int i = 0;
+
+	while (2 * i + 1 < __heap.nr) {
+		unsigned int child = 2 * i + 1;
+
+		if (child + 1 < __heap.nr && __before(__heap.events + child + 1, __heap.events + child))
+			child++;
+		if (!__before(__heap.events + child, &last))
+			break;
+		__heap.events[i] = __heap.events[child];
+		i = child;
+	}
+	__heap.events[i] = last;
+	return top;
+}
+
+/**
+ * Set the clock to @now, and @ticks to the tick it is in
+ */
+static void __set_clock(unsigned long long now)
+{
+	__now_ns = now;
+	ticks = now / __tick_ns;
+}
+
+/**
+ * Time of the next event, or -1 if there is none
+ */
+static unsigned long long __next_event(void)
+{
+	unsigned long long next = __heap.nr ? __heap.events[0].at : -1ULL;
+
+	/* Not in @heap until its tick, but forked no earlier than that */
+	if (!list_empty(&__forkqueue)) {
+		struct process *p = list_first_entry(&__forkqueue, struct process, list);
+		unsigned long long at = (unsigned long long)p->cold->__starts_at * __tick_ns;
+
+		if (at < next)
+			next = at;
+	}
+	return next;
+}
+
+/**
+ * Keep @age of @p in ticks along with the time it ran. It reaches @lifespan
+ * only when @p completes
+ */
+static void __update_age(struct process *p)
+{
+	struct process_cold *cold = p->cold;
+
+	if (cold->__ns_age == cold->__ns_lifespan) {
+		p->age = p->lifespan;
+	} else {
+		p->age = cold->__ns_age / __tick_ns;
+		if (p->age >= p->lifespan)
+			p->age = p->lifespan - 1;
+	}
+}
+
+/**
+ * Start the I/O scheduled at the current age of @p. See __start_io()
+ */
+static bool __start_io_ns(struct process *p)
+{
+	struct io_schedule *io;
+
+	list_for_each_entry(io, &p->cold->__io_to_do, list) {
+		if (io->at_ns != p->cold->__ns_age || !io->duration_ns)
+			continue;
+
+		p->status = PROCESS_BLOCKED;
+		p->cold->__ns_io += io->duration_ns;
+		__heap_push(p, __now_ns + io->duration_ns, false);
+		__heap.nr_io++;
+		__log_event(EVENT_IO, p->pid, 0);
+
+		list_del(&io->list);
+		free(io);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Queue the processes forked in the current tick, and process the events up
+ * to now
+ */
+static void __process_events(const struct scheduler *s)
+{
+	struct process *p, *tmp;
+
+	__fill_from_stream();
+
+	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
+		if (p->cold->__starts_at > ticks)
+			break;
+		list_del_init(&p->list);
+		__heap_push(p, p->cold->__ns_starts_at, true);
+	}
+
+	while (__heap.nr && __heap.events[0].at <= __now_ns) {
+		struct __ns_event e = __heap_pop();
+
+		if (!e.fork) {
+			__heap.nr_io--;
+			__phase_enter(PROFILE_IO);
+			__complete_io(e.p);
+			__phase_leave(PROFILE_IO);
+			continue;
+		}
+
+		if (__admission && !__admit(e.p))
+			continue;
+
+		__phase_enter(PROFILE_FORK);
+		e.p->status = PROCESS_READY;
+		__log_event(EVENT_FORK, e.p->pid, 0);
+
+		if (!__start_io_ns(e.p))
+			ready_enqueue(e.p);
+
+		if (s->forked)
+			s->forked(e.p);
+		__phase_leave(PROFILE_FORK);
+	}
+}
+
+static void __exit_process_ns(const struct scheduler *s, struct process *p)
+{
+	struct process_cold *cold = p->cold;
+	unsigned long long turnaround = __now_ns - cold->__ns_starts_at;
+	struct io_schedule *io, *tmp;
+
+	__phase_enter(PROFILE_EXIT);
+
+	assert(list_empty(&p->list));
+	assert(!cold->__ready_index);
+	assert(list_empty(&cold->__resources_holding));
+	assert(list_empty(&cold->__resources_to_acquire));
+
+	list_for_each_entry_safe(io, tmp, &cold->__io_to_do, list) {
+		list_del(&io->list);
+		free(io);
+	}
+
+	if (s->exiting)
+		s->exiting(p);
+
+	__log_event(EVENT_EXIT, p->pid, 0);
+
+	__stats.nr_exited++;
+	__stats.turnaround += turnaround;
+	__stats.waiting += turnaround - cold->__ns_lifespan - cold->__ns_io;
+	if (__stats.max_turnaround < turnaround)
+		__stats.max_turnaround = turnaround;
+
+	__free_process(p);
+
+	__phase_leave(PROFILE_EXIT);
+}
+
+/**
+ * Acquire the resources scheduled at the current age of @current. Returns
+ * false if @current gets blocked. See __run_current_acquire()
+ */
+static bool __acquire_ns(const struct scheduler *s)
+{
+	struct resource_schedule *rs, *tmp;
+
+	__phase_enter(PROFILE_ACQUIRE);
+
+	list_for_each_entry_safe(rs, tmp, &current->cold->__resources_to_acquire, list) {
+		if (rs->at_ns != current->cold->__ns_age)
+			continue;
+
+		assert(s->acquire && "scheduler.acquire() not implemented");
+
+		current->cold->wants_shared = rs->shared;
+		if (!s->acquire(rs->resource_id)) {
+			__contention_blocked(current, rs);
+			__log_event(EVENT_BLOCKED, current->pid, rs->resource_id);
+			__phase_leave(PROFILE_ACQUIRE);
+			return false;
+		}
+		__contention_acquired(current, rs);
+
+		/* Released when it has run for the duration from now */
+		rs->duration_ns += current->cold->__ns_age;
+		list_move_tail(&rs->list, &current->cold->__resources_holding);
+
+		__log_event(EVENT_ACQUIRED, current->pid, rs->resource_id);
+	}
+
+	__phase_leave(PROFILE_ACQUIRE);
+	return true;
+}
+
+static void __release_ns(const struct scheduler *s)
+{
+	struct resource_schedule *rs, *tmp;
+
+	__phase_enter(PROFILE_RELEASE);
+
+	list_for_each_entry_safe(rs, tmp, &current->cold->__resources_holding, list) {
+		if (rs->duration_ns != current->cold->__ns_age)
+			continue;
+
+		assert(s->release && "scheduler.release() not implemented");
+
+		s->release(rs->resource_id);
+		__contention_released(rs);
+
+		__log_event(EVENT_RELEASED, current->pid, rs->resource_id);
+
+		list_del(&rs->list);
+		free(rs);
+	}
+
+	__phase_leave(PROFILE_RELEASE);
+}
+
+/**
+ * How long @current can run from now before anything happens
+ */
+static unsigned long long __burst(void)
+{
+	struct process_cold *cold = current->cold;
+	unsigned long long age = cold->__ns_age;
+	unsigned long long until = cold->__ns_lifespan;
+	unsigned long long next = __next_event();
+	unsigned long long burst;
+	struct resource_schedule *rs;
+	struct io_schedule *io;
+
+	list_for_each_entry(rs, &cold->__resources_to_acquire, list) {
+		if (rs->at_ns > age && rs->at_ns < until)
+			until = rs->at_ns;
+	}
+	list_for_each_entry(rs, &cold->__resources_holding, list) {
+		if (rs->duration_ns < until)
+			until = rs->duration_ns;
+	}
+	list_for_each_entry(io, &cold->__io_to_do, list) {
+		if (io->at_ns > age && io->at_ns < until)
+			until = io->at_ns;
+	}
+	burst = until - age;
+
+	/* Up to the end of the tick, and to the next event */
+	if ((ticks + 1ULL) * __tick_ns - __now_ns < burst)
+		burst = (ticks + 1ULL) * __tick_ns - __now_ns;
+	if (next > __now_ns && next - __now_ns < burst)
+		burst = next - __now_ns;
+
+	return burst;
+}
+
+/***********************************************************************
+ * The main loop for the simulation in continuous time
+ */
+void __continuous_simulate(const struct scheduler *s)
+{
+	assert(s->schedule && "scheduler.schedule() not implemented");
+
+	__set_clock(0);
+
+	while (true) {
+		struct process *prev;
+		unsigned long long burst;
+
+		__process_events(s);
+
+		prev = current;
+		__need_resched = false;
+		current = s->schedule();
+
+		if (prev) {
+			if (prev->status == PROCESS_RUNNING)
+				prev->status = PROCESS_READY;
+
+			if (prev->cold->__ns_age == prev->cold->__ns_lifespan) {
+				prev->status = PROCESS_EXIT;
+				__exit_process_ns(s, prev);
+			}
+		}
+
+		if (!current) {
+			unsigned long long next = __next_event();
+
+			if (!__ready_pending() && next == -1ULL)
+				break;
+
+			/* Idle up to the next event */
+			__log_event(EVENT_IDLE, 0, 0);
+			__stats.nr_idle += next - __now_ns;
+			__set_clock(next);
+			continue;
+		}
+
+		current->status = PROCESS_RUNNING;
+		assert(list_empty(&current->list));
+
+		if (current->cold->__woken_at)
+			__wake_dispatched(current);
+
+		if (current != prev) {
+			if (!current->cold->__nr_dispatches)
+				__stats.response += __now_ns - current->cold->__ns_starts_at;
+			current->cold->__nr_dispatches++;
+			__stats.nr_dispatches++;
+
+			if (__switch_ns) {
+				__switched_ns += __switch_ns;
+				__set_clock(__now_ns + __switch_ns);
+
+				/* Queue what happened meanwhile, to be scheduled after the burst */
+				__process_events(s);
+			}
+		}
+
+		/* Keep running through its own points up to the end of the tick or an event */
+		do {
+			if (!__acquire_ns(s))
+				break;
+
+			/* Lifespan of 0 */
+			if (current->cold->__ns_age == current->cold->__ns_lifespan)
+				break;
+
+			burst = __burst();
+			__log_event(EVENT_RUN, current->pid, 0);
+
+			current->cold->__ns_age += burst;
+			__update_age(current);
+			__set_clock(__now_ns + burst);
+
+			__release_ns(s);
+
+			if (current->cold->__ns_age == current->cold->__ns_lifespan ||
+			    __start_io_ns(current))
+				break;
+		} while (__now_ns % __tick_ns && __next_event() > __now_ns && !__need_resched);
+	}
+
+	__stats.ticks = __now_ns;
+
+	free(__heap.events);
+	__heap.events = NULL;
+	__heap.nr = __heap.size = 0;
+}
+
+/***********************************************************************
+ * Report where the time went in the continuous time
+ */
+/**
+ * # of the processes blocked for I/O
+ */
+unsigned int __continuous_io_pending(void)
+{
+	return __heap.nr_io;
+}
+
+void __continuous_report(void)
+{
+	printf("\nFinished at %llu ns with ticks of %llu ns\n", __stats.ticks, __tick_ns);
+	printf("Idle for %llu ns, switched %llu times for %llu ns in total\n",
+	       __stats.nr_idle, __stats.nr_dispatches, __switched_ns);
+}
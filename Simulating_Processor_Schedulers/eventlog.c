@@ -0,0 +1,359 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "simulator.h"
+
+extern __thread unsigned int ticks;
+
+bool __sync_log = false;
+
+/**
+ * The event log. The simulation thread pushes binary records into @ring, and
+ * the writer thread formats them into @buffer and writes it out to stderr.
+ *
+ * @ring is a single-producer/single-consumer ring. Only the simulation thread
+ * advances @head and only the writer advances @tail, so they synchronize with
+ * the acquire/release on the indices without a lock. The simulation thread
+ * waits for the writer when @ring is full. The writer writes out @buffer
+ * whenever it runs out of records, and then sleeps on @wakeup until more
+ * records arrive. @sleeping tells the simulation thread to wake it up.
+ *
+ * Without the writer, the records are formatted and written out right away
+ * on the simulation thread.
+ *
+ * The threads simulating the partitions of the CPUs keep their records in
+ * their own struct __log_buffer instead, which the simulation thread pushes
+ * into @ring in the order of the partitions. So there is still one producer,
+ * and the log does not depend on how the threads interleave.
+ */
+#define EVENTLOG_SIZE	4096	/* # of records in the ring. Power of 2 */
+#define EVENTLOG_MASK	(EVENTLOG_SIZE - 1)
+#define EVENTLOG_BUFFER	65536
+
+struct __event {
+	unsigned long long ticks;	/* ns with --tick-ns */
+	unsigned int pid;
+	enum event_type type;
+	int arg;
+};
+
+static struct {
+	struct __event ring[EVENTLOG_SIZE];
+
+	/* On their own cache lines not to bounce between the threads */
+	unsigned long head __attribute__((aligned(64)));
+	unsigned long tail __attribute__((aligned(64)));
+	unsigned long flushed;	/* Records up to this are written out */
+	bool sleeping;
+	bool stop;
+
+	pthread_t writer;
+	bool running;
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+
+	char buffer[EVENTLOG_BUFFER];
+	size_t len;
+} __log = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+struct __log_buffer {
+	struct __event *events;
+	unsigned int nr;
+	unsigned int size;
+	unsigned int next;		/* Next one to push into @ring */
+};
+
+/* Where the events are logged on this thread instead of @ring */
+static __thread struct __log_buffer *__log_local = NULL;
+
+static void __log_flush(void)
+{
+	fwrite(__log.buffer, 1, __log.len, stderr);
+	__log.len = 0;
+}
+
+static void __log_append(const char *str, size_t len)
+{
+	if (__log.len + len > EVENTLOG_BUFFER)
+		__log_flush();
+	memcpy(__log.buffer + __log.len, str, len);
+	__log.len += len;
+}
+
+/**
+ * Events are indented by the pid, which can be larger than the buffer
+ */
+static void __log_indent(unsigned int pid)
+{
+	static const char spaces[] = "                                                                ";
+
+	while (pid) {
+		unsigned int nr = pid < (sizeof(spaces) - 1) / 4 ? pid : (sizeof(spaces) - 1) / 4;
+
+		__log_append(spaces, nr * 4);
+		pid -= nr;
+	}
+}
+
+static void __log_format(const struct __event *e)
+{
+	char str[32];
+	int len;
+
+	len = snprintf(str, sizeof(str), "%3llu: ", e->ticks);
+	__log_append(str, len);
+
+	switch (e->type) {
+	case EVENT_IDLE:
+		__log_append("idle\n", 5);
+		return;
+	case EVENT_RUN:
+		/* @arg is the CPU + 1 with several CPUs */
+		if (e->arg)
+			len = snprintf(str, sizeof(str), "%d@%d\n", e->pid, e->arg - 1);
+		else
+			len = snprintf(str, sizeof(str), "%d\n", e->pid);
+		break;
+	case EVENT_WARMUP:
+		len = snprintf(str, sizeof(str), "%d@%d*\n", e->pid, e->arg - 1);
+		break;
+	case EVENT_FORK:
+		len = snprintf(str, sizeof(str), "N\n");
+		break;
+	case EVENT_EXIT:
+		len = snprintf(str, sizeof(str), "X\n");
+		break;
+	case EVENT_IO:
+		len = snprintf(str, sizeof(str), "I\n");
+		break;
+	case EVENT_WAKE:
+		len = snprintf(str, sizeof(str), "W\n");
+		break;
+	case EVENT_REJECTED:
+		len = snprintf(str, sizeof(str), "R\n");
+		break;
+	case EVENT_BLOCKED:
+		len = snprintf(str, sizeof(str), "\b\b=[%d]\n", e->arg);
+		break;
+	case EVENT_ACQUIRED:
+		len = snprintf(str, sizeof(str), "\b\b+[%d]\n", e->arg);
+		break;
+	case EVENT_RELEASED:
+		len = snprintf(str, sizeof(str), "\b\b-[%d]\n", e->arg);
+		break;
+	}
+	__log_indent(e->pid);
+	__log_append(str, len);
+}
+
+static void *__log_writer(void *data)
+{
+	unsigned long tail = __log.tail;
+	bool stop;
+
+	while (true) {
+		unsigned long head = __atomic_load_n(&__log.head, __ATOMIC_ACQUIRE);
+
+		if (tail != head) {
+			for (; tail != head; tail++) {
+				__log_format(__log.ring + (tail & EVENTLOG_MASK));
+			}
+			__atomic_store_n(&__log.tail, tail, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		/* Ran out of records. Write out what is formatted so far and sleep */
+		__log_flush();
+		__atomic_store_n(&__log.flushed, tail, __ATOMIC_RELEASE);
+
+		pthread_mutex_lock(&__log.lock);
+		__atomic_store_n(&__log.sleeping, true, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&__log.head, __ATOMIC_SEQ_CST) == tail && !__log.stop) {
+			pthread_cond_wait(&__log.wakeup, &__log.lock);
+		}
+		__atomic_store_n(&__log.sleeping, false, __ATOMIC_SEQ_CST);
+		stop = __log.stop;
+		pthread_mutex_unlock(&__log.lock);
+
+		/* Stopped after writing out all the records */
+		if (stop && __atomic_load_n(&__log.head, __ATOMIC_ACQUIRE) == tail)
+			break;
+	}
+	return NULL;
+}
+
+static void __log_wakeup(void)
+{
+	pthread_mutex_lock(&__log.lock);
+	pthread_cond_signal(&__log.wakeup);
+	pthread_mutex_unlock(&__log.lock);
+}
+
+static void __log_push(const struct __event *event)
+{
+	unsigned long head = __log.head;
+
+	if (!__log.running) {
+		__log_format(event);
+		__log_flush();
+		return;
+	}
+
+	/* Wait for the writer to make a room */
+	while (head - __atomic_load_n(&__log.tail, __ATOMIC_ACQUIRE) == EVENTLOG_SIZE) {
+		sched_yield();
+	}
+
+	__log.ring[head & EVENTLOG_MASK] = *event;
+	__atomic_store_n(&__log.head, head + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&__log.sleeping, __ATOMIC_SEQ_CST))
+		__log_wakeup();
+}
+
+/**
+ * Log the event of @type of process @pid at the current tick, or at the
+ * current ns with --tick-ns. @arg is the resource for the resource events
+ */
+void __log_event(enum event_type type, unsigned int pid, int arg)
+{
+	struct __event e = { __tick_ns ? __now_ns : ticks, pid, type, arg };
+	struct __log_buffer *b = __log_local;
+
+	if (__timeline)
+		__timeline_record(e.ticks, type, pid, arg);
+
+	if (!b) {
+		__log_push(&e);
+		return;
+	}
+
+	if (b->nr == b->size) {
+		b->size = b->size ? b->size * 2 : 256;
+		b->events = realloc(b->events, sizeof(*b->events) * b->size);
+		assert(b->events);
+	}
+	b->events[b->nr++] = e;
+}
+
+/***********************************************************************
+ * Event buffers of the partitions
+ */
+struct __log_buffer *__log_buffer_alloc(void)
+{
+	struct __log_buffer *b = calloc(1, sizeof(*b));
+
+	assert(b);
+	return b;
+}
+
+void __log_buffer_free(struct __log_buffer *b)
+{
+	free(b->events);
+	free(b);
+}
+
+/**
+ * Log the events on this thread into @b, or into the log again if NULL
+ */
+void __log_redirect(struct __log_buffer *b)
+{
+	__log_local = b;
+}
+
+/**
+ * Push the events in @b logged before tick @until into the log. The buffer is
+ * emptied once all of them are pushed
+ */
+void __log_replay(struct __log_buffer *b, unsigned int until)
+{
+	for (; b->next < b->nr && b->events[b->next].ticks < until; b->next++) {
+		__log_push(b->events + b->next);
+	}
+	if (b->next == b->nr)
+		b->nr = b->next = 0;
+}
+
+/**
+ * Wait until the events logged so far are written out, so that other outputs
+ * of the simulation thread follow them
+ */
+void __log_sync(void)
+{
+	if (!__log.running)
+		return;
+
+	while (__atomic_load_n(&__log.flushed, __ATOMIC_ACQUIRE) != __log.head) {
+		sched_yield();
+	}
+}
+
+/**
+ * Do not lose the events logged before an assertion fails
+ */
+static void __log_abort(int signum)
+{
+	__log_sync();
+	signal(signum, SIG_DFL);
+	raise(signum);
+}
+
+/**
+ * Start the writer thread unless @__sync_log is set. Fall back to write the
+ * events on the simulation thread if the writer cannot be started
+ */
+void __log_start(void)
+{
+	if (__sync_log)
+		return;
+
+	__log.stop = false;
+	if (pthread_create(&__log.writer, NULL, __log_writer, NULL)) {
+		perror("pthread_create");
+		return;
+	}
+	__log.running = true;
+	signal(SIGABRT, __log_abort);
+}
+
+/**
+ * Write out the remaining events and stop the writer thread
+ */
+void __log_stop(void)
+{
+	if (!__log.running)
+		return;
+
+	pthread_mutex_lock(&__log.lock);
+	__log.stop = true;
+	pthread_cond_signal(&__log.wakeup);
+	pthread_mutex_unlock(&__log.lock);
+
+	pthread_join(__log.writer, NULL);
+	__log.running = false;
+	signal(SIGABRT, SIG_DFL);
+}
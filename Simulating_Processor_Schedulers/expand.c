@@ -0,0 +1,621 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/* For getline() */
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "parser.h"
+#include "simulator.h"
+
+/**
+ * Extensions of the process script, expanded line by line as the script is
+ * streamed, so the processes they describe are never all in memory:
+ *
+ *   repeat N [var]      Repeat the lines up to the matching end N times, with
+ *     ...               @var (i by default) counting from 0.
+ *   end
+ *
+ *   template name       Lines to put into the processes with like name.
+ *     ...
+ *   end
+ *
+ *   process a..b [like name]
+ *     ...               Processes a to b, all described by the lines up to
+ *   end                 the end. @pid is the pid of each.
+ *
+ *   like name           Put the lines of template @name here.
+ *   seed n              Seed the random numbers below.
+ *
+ * The numbers in the lines can be expressions written without spaces, of
+ * integers, variables (the indices of the repeats and @pid), + - * / % and
+ * parentheses, and the functions:
+ *
+ *   uniform(a,b)  Uniformly distributed integer in [a, b]
+ *   exp(mean)     Exponentially distributed
+ *   normal(mean,sd)
+ *                 Normally distributed, rounded and clamped at 0
+ *   min(a,b), max(a,b)
+ *
+ * A block being repeated is recorded as text, and read again for each
+ * iteration. Nested blocks are recorded again from the enclosing one.
+ */
+#define EXPAND_MAX_DEPTH		16
+#define EXPAND_MAX_TEMPLATES	64
+
+struct __block {
+	char *text;				/* Lines, each ending with \n */
+	size_t len;
+	size_t size;
+};
+
+struct __frame {
+	const struct __block *body;
+	bool owned;				/* @body is freed as the frame is popped */
+	const char *curr;		/* Next line in @body */
+	char var[MAX_TOKEN_LEN];
+	long long first;		/* @var goes from @first to @last */
+	long long last;
+	long long value;
+};
+
+static struct {
+	const char *filename;
+	FILE *file;
+
+	struct __frame frames[EXPAND_MAX_DEPTH];
+	unsigned int depth;
+
+	struct {
+		char name[MAX_TOKEN_LEN];
+		struct __block body;
+	} templates[EXPAND_MAX_TEMPLATES];
+	unsigned int nr_templates;
+
+	long long pid;			/* Pid of the process being described */
+	unsigned long long rng;
+
+	char *line;				/* Grown to fit the longest line read */
+	size_t size;
+	char values[MAX_NR_TOKENS][24];	/* Evaluated numbers in @line */
+} __expand = {
+	.rng = 1,
+};
+
+static void __expand_error(const char *what, const struct token *token)
+{
+	fprintf(stderr, "%s %.*s\n", what, token->len, token->str);
+	exit(EXIT_FAILURE);
+}
+
+/***********************************************************************
+ * Expressions
+ */
+
+/**
+ * splitmix64 as the generator in arrival.c does
+ */
+static unsigned long long __random(void)
+{
+	unsigned long long z = (__expand.rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Uniform in (0, 1] */
+static double __random_unit(void)
+{
+	return ((__random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+struct __eval {
+	const char *curr;
+	const char *end;
+	bool error;
+};
+
+static long long __expr(struct __eval *e);
+
+static bool __accept(struct __eval *e, char c)
+{
+	if (e->curr < e->end && *e->curr == c) {
+		e->curr++;
+		return true;
+	}
+	return false;
+}
+
+static bool __is_ident(char c, bool first)
+{
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(!first && c >= '0' && c <= '9');
+}
+
+static long long __variable(struct __eval *e, const char *name, unsigned int len)
+{
+	for (int i = __expand.depth - 1; i >= 0; i--) {
+		if (strlen(__expand.frames[i].var) == len && !memcmp(__expand.frames[i].var, name, len))
+			return __expand.frames[i].value;
+	}
+	if (len == 3 && !memcmp(name, "pid", 3))
+		return __expand.pid;
+
+	e->error = true;
+	return 0;
+}
+
+static long long __function(struct __eval *e, const char *name, unsigned int len)
+{
+	long long args[2] = { 0 };
+	unsigned int nr = 0;
+
+	if (!__accept(e, ')')) {
+		do {
+			long long v = __expr(e);
+
+			if (nr < 2)
+				args[nr] = v;
+			nr++;
+		} while (__accept(e, ','));
+
+		if (!__accept(e, ')'))
+			e->error = true;
+	}
+
+#define FUNCTION(str, nr_args) (len == sizeof(str) - 1 && !memcmp(name, str, len) && nr == (nr_args))
+	if (FUNCTION("uniform", 2) && args[0] <= args[1])
+		return args[0] + __random() % (args[1] - args[0] + 1);
+	if (FUNCTION("exp", 1))
+		return -log(__random_unit()) * args[0];
+	if (FUNCTION("normal", 2)) {
+		/* Box-Muller */
+		double z = sqrt(-2 * log(__random_unit())) * cos(2 * 3.14159265358979323846 * __random_unit());
+		double v = args[0] + z * args[1];
+
+		return v > 0 ? llround(v) : 0;
+	}
+	if (FUNCTION("min", 2))
+		return args[0] < args[1] ? args[0] : args[1];
+	if (FUNCTION("max", 2))
+		return args[0] > args[1] ? args[0] : args[1];
+#undef FUNCTION
+
+	e->error = true;
+	return 0;
+}
+
+static long long __primary(struct __eval *e)
+{
+	long long v = 0;
+
+	if (__accept(e, '(')) {
+		v = __expr(e);
+		if (!__accept(e, ')'))
+			e->error = true;
+		return v;
+	}
+	if (__accept(e, '-'))
+		return -__primary(e);
+
+	if (e->curr < e->end && *e->curr >= '0' && *e->curr <= '9') {
+		for (; e->curr < e->end && *e->curr >= '0' && *e->curr <= '9'; e->curr++) {
+			v = v * 10 + (*e->curr - '0');
+		}
+		return v;
+	}
+
+	if (e->curr < e->end && __is_ident(*e->curr, true)) {
+		const char *name = e->curr;
+
+		while (e->curr < e->end && __is_ident(*e->curr, false)) {
+			e->curr++;
+		}
+		if (__accept(e, '('))
+			return __function(e, name, e->curr - 1 - name);
+		return __variable(e, name, e->curr - name);
+	}
+
+	e->error = true;
+	return 0;
+}
+
+static long long __term(struct __eval *e)
+{
+	long long v = __primary(e);
+
+	while (!e->error) {
+		if (__accept(e, '*')) {
+			v *= __primary(e);
+		} else if (__accept(e, '/') || __accept(e, '%')) {
+			bool div = e->curr[-1] == '/';
+			long long d = __primary(e);
+
+			if (!d) {
+				e->error = true;
+				break;
+			}
+			v = div ? v / d : v % d;
+		} else {
+			break;
+		}
+	}
+	return v;
+}
+
+static long long __expr(struct __eval *e)
+{
+	long long v = __term(e);
+
+	while (!e->error) {
+		if (__accept(e, '+')) {
+			v += __term(e);
+		} else if (__accept(e, '-')) {
+			v -= __term(e);
+		} else {
+			break;
+		}
+	}
+	return v;
+}
+
+static long long __evaluate(const char *str, unsigned int len)
+{
+	struct __eval e = { str, str + len, false };
+	long long v = __expr(&e);
+
+	if (e.error || e.curr != e.end) {
+		struct token token = { str, len };
+
+		__expand_error("Invalid expression", &token);
+	}
+	return v;
+}
+
+/**
+ * Whether @token is a number already, which can be a time with --tick-ns
+ */
+static bool __is_number(const struct token *token)
+{
+	unsigned long long ns;
+
+	if (__tick_ns && token_to_ns(token, __tick_ns, &ns))
+		return true;
+
+	for (unsigned int i = 0; i < token->len; i++) {
+		if (token->str[i] < '0' || token->str[i] > '9')
+			return false;
+	}
+	return token->len > 0;
+}
+
+/**
+ * Replace the numbers at @mask in @tokens with their values
+ */
+static void __evaluate_tokens(struct token tokens[], int nr_tokens, unsigned int mask)
+{
+	for (int i = 1; i < nr_tokens && i < MAX_NR_TOKENS; i++) {
+		char *value = __expand.values[i];
+
+		if (!(mask & (1U << i)) || __is_number(tokens + i))
+			continue;
+
+		tokens[i].len = snprintf(value, sizeof(__expand.values[i]), "%lld",
+					 __evaluate(tokens[i].str, tokens[i].len));
+		tokens[i].str = value;
+	}
+}
+
+/***********************************************************************
+ * Sources of the lines
+ */
+static bool __is(const struct token *token, const char *str)
+{
+	return token->len == strlen(str) && !memcmp(token->str, str, token->len);
+}
+
+/**
+ * Read the next line from the innermost frame, or from the file. At the end
+ * of the frame, the frame goes to the next iteration or is popped unless
+ * @raw, in which case NULL is returned
+ */
+static const char *__read_line(bool raw)
+{
+	while (__expand.depth) {
+		struct __frame *f = __expand.frames + __expand.depth - 1;
+		const char *eol;
+		size_t len;
+
+		if (f->curr == f->body->text + f->body->len) {
+			if (raw)
+				return NULL;
+			if (f->value < f->last) {
+				f->value++;
+				f->curr = f->body->text;
+				continue;
+			}
+			if (f->owned) {
+				free(f->body->text);
+				free((void *)f->body);
+			}
+			__expand.depth--;
+			continue;
+		}
+
+		eol = memchr(f->curr, '\n', f->body->text + f->body->len - f->curr);
+		len = eol - f->curr;
+		if (len + 1 > __expand.size) {
+			__expand.size = len + 1;
+			__expand.line = realloc(__expand.line, __expand.size);
+			assert(__expand.line);
+		}
+		memcpy(__expand.line, f->curr, len);
+		__expand.line[len] = '\0';
+		f->curr = eol + 1;
+		return __expand.line;
+	}
+
+	/* Read the whole line however long it is, as the mmapped script is */
+	if (getline(&__expand.line, &__expand.size, __expand.file) < 0)
+		return NULL;
+	return __expand.line;
+}
+
+static void __append(struct __block *b, const char *str, size_t len)
+{
+	while (b->len + len + 1 > b->size) {
+		b->size = b->size ? b->size * 2 : 256;
+		b->text = realloc(b->text, b->size);
+		assert(b->text);
+	}
+	memcpy(b->text + b->len, str, len);
+	b->len += len;
+	b->text[b->len++] = '\n';
+}
+
+/**
+ * Record the lines up to the end matching the block just opened into @b,
+ * including the end if @with_end
+ */
+static void __record(struct __block *b, bool with_end)
+{
+	unsigned int nested = 0;
+	const char *line;
+
+	while ((line = __read_line(true))) {
+		struct token tokens[MAX_NR_TOKENS];
+		int nr_tokens;
+		size_t len = strcspn(line, "\n");
+
+		scan_line(line, line + len, tokens, &nr_tokens);
+		if (nr_tokens && __is(tokens, "end") && !nested--) {
+			if (with_end)
+				__append(b, line, len);
+			return;
+		}
+		if (nr_tokens && (__is(tokens, "process") || __is(tokens, "repeat") ||
+				  __is(tokens, "template"))) {
+			nested++;
+		}
+		__append(b, line, len);
+	}
+	fprintf(stderr, "No end for the block\n");
+	exit(EXIT_FAILURE);
+}
+
+static void __push(const struct __block *body, bool owned, const char *var,
+		   long long first, long long last)
+{
+	struct __frame *f;
+
+	if (__expand.depth == EXPAND_MAX_DEPTH) {
+		fprintf(stderr, "Blocks nested too deep\n");
+		exit(EXIT_FAILURE);
+	}
+
+	f = __expand.frames + __expand.depth++;
+	f->body = body;
+	f->owned = owned;
+	f->curr = body->text;
+	snprintf(f->var, sizeof(f->var), "%s", var);
+	f->first = f->value = first;
+	f->last = last;
+}
+
+static void __like(const struct token *name)
+{
+	for (unsigned int i = 0; i < __expand.nr_templates; i++) {
+		if (__is(name, __expand.templates[i].name)) {
+			if (__expand.templates[i].body.len)
+				__push(&__expand.templates[i].body, false, "", 0, 0);
+			return;
+		}
+	}
+	__expand_error("Unknown template", name);
+}
+
+static void __template(const struct token *name)
+{
+	unsigned int i;
+
+	if (name->len >= MAX_TOKEN_LEN)
+		__expand_error("Too long template name", name);
+
+	for (i = 0; i < __expand.nr_templates; i++) {
+		if (__is(name, __expand.templates[i].name))
+			break;
+	}
+	if (i == EXPAND_MAX_TEMPLATES) {
+		fprintf(stderr, "Too many templates\n");
+		exit(EXIT_FAILURE);
+	}
+	if (i == __expand.nr_templates) {
+		memcpy(__expand.templates[i].name, name->str, name->len);
+		__expand.templates[i].name[name->len] = '\0';
+		__expand.nr_templates++;
+	}
+
+	/* Redefined */
+	__expand.templates[i].body.len = 0;
+	__record(&__expand.templates[i].body, false);
+}
+
+static struct __block *__new_block(void)
+{
+	struct __block *b = calloc(1, sizeof(*b));
+
+	assert(b);
+	return b;
+}
+
+static void __repeat(struct token tokens[], int nr_tokens)
+{
+	struct __block *body = __new_block();
+	long long count = __evaluate(tokens[1].str, tokens[1].len);
+	char var[MAX_TOKEN_LEN] = "i";
+
+	if (nr_tokens >= 3) {
+		if (tokens[2].len >= MAX_TOKEN_LEN)
+			__expand_error("Too long variable", tokens + 2);
+		memcpy(var, tokens[2].str, tokens[2].len);
+		var[tokens[2].len] = '\0';
+	}
+
+	__record(body, false);
+	if (count <= 0 || !body->len) {
+		free(body->text);
+		free(body);
+		return;
+	}
+	__push(body, true, var, 0, count - 1);
+}
+
+/**
+ * Processes a..b, where @dots is at .. in @tokens[1]. The process line is
+ * made up for each
+ */
+static void __ranged_process(struct token tokens[], int nr_tokens, const char *dots)
+{
+	struct __block *body = __new_block();
+	long long first = __evaluate(tokens[1].str, dots - tokens[1].str);
+	long long last = __evaluate(dots + 2, tokens[1].str + tokens[1].len - dots - 2);
+	char like[MAX_TOKEN_LEN + 8];
+
+	__append(body, "process pid", 11);
+	if (nr_tokens == 4 && __is(tokens + 2, "like")) {
+		int len = snprintf(like, sizeof(like), "like %.*s", tokens[3].len, tokens[3].str);
+
+		__append(body, like, len);
+	}
+	__record(body, true);
+
+	if (first > last) {
+		free(body->text);
+		free(body);
+		return;
+	}
+	__push(body, true, "pid", first, last);
+}
+
+/***********************************************************************
+ * Read the next line of __expand_open()ed script into @tokens with the
+ * extensions expanded. Returns false at the end of the script
+ */
+bool __expand_line(struct token tokens[], int *nr_tokens)
+{
+	const char *line;
+
+	if (!__expand.file && !(__expand.file = fopen(__expand.filename, "r"))) {
+		perror(__expand.filename);
+		exit(EXIT_FAILURE);
+	}
+
+	while ((line = __read_line(false))) {
+		int nr;
+
+		scan_line(line, line + strlen(line), tokens, &nr);
+		if (!nr)
+			continue;
+		if (nr < 0) {
+			fprintf(stderr, "Too many tokens in the line of %.*s\n", tokens[0].len, tokens[0].str);
+			exit(EXIT_FAILURE);
+		}
+
+		if (__is(tokens, "repeat") && (nr == 2 || nr == 3)) {
+			__repeat(tokens, nr);
+			continue;
+		}
+		if (__is(tokens, "template") && nr == 2) {
+			__template(tokens + 1);
+			continue;
+		}
+		if (__is(tokens, "like") && nr == 2) {
+			__like(tokens + 1);
+			continue;
+		}
+		if (__is(tokens, "seed") && nr == 2) {
+			__expand.rng = __evaluate(tokens[1].str, tokens[1].len);
+			continue;
+		}
+
+		if (__is(tokens, "process") && nr >= 2) {
+			const char *dots = NULL;
+
+			for (unsigned int i = 1; i < tokens[1].len && !dots; i++) {
+				if (tokens[1].str[i - 1] == '.' && tokens[1].str[i] == '.')
+					dots = tokens[1].str + i - 1;
+			}
+			if (dots) {
+				__ranged_process(tokens, nr, dots);
+				continue;
+			}
+			__evaluate_tokens(tokens, 2, 1U << 1);
+			__expand.pid = token_to_int(tokens + 1);
+
+			if (nr == 4 && __is(tokens + 2, "like"))
+				__like(tokens + 3);
+			*nr_tokens = 2;
+			return true;
+		}
+
+		__evaluate_tokens(tokens, nr, __script_numbers(tokens, nr));
+		*nr_tokens = nr;
+		return true;
+	}
+
+	fclose(__expand.file);
+	__expand.file = NULL;
+	free(__expand.line);
+	__expand.line = NULL;
+	__expand.size = 0;
+	return false;
+}
+
+/**
+ * The script is opened as the first line is read, so that each scheduler
+ * under -A reads it on its own
+ */
+void __expand_open(const char *filename)
+{
+	__expand.filename = filename;
+}
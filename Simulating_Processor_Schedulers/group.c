@@ -0,0 +1,274 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "simulator.h"
+#include "ready.h"
+
+extern __thread struct process *current;
+
+/**
+ * Groups declared with the group keyword. Processes not put into a group
+ * belong to the default group, which can be declared to set its weight
+ */
+struct __group __groups[MAX_GROUPS] = {
+	{ .name = "default", .weight = 1 },
+};
+unsigned int __nr_groups = 1;
+
+/**
+ * Virtual time of the group picked last. A group becoming runnable starts
+ * from here so that it does not claim the time it was not runnable for
+ */
+unsigned long long __group_min_vruntime = 0;
+
+int __group_lookup(const char *name, unsigned int len)
+{
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		if (strlen(__groups[i].name) == len && !memcmp(__groups[i].name, name, len))
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * Declare group @name with @weight, or update the weight if it is declared
+ * already. Returns the group, or -1 if there are too many groups
+ */
+int __group_declare(const char *name, unsigned int len, unsigned int weight)
+{
+	int g = __group_lookup(name, len);
+
+	assert(len < GROUP_NAME_LEN);
+	assert(weight > 0 && weight <= GROUP_MAX_WEIGHT);
+
+	if (g < 0) {
+		if (__nr_groups == MAX_GROUPS)
+			return -1;
+		g = __nr_groups++;
+		memcpy(__groups[g].name, name, len);
+		__groups[g].name[len] = '\0';
+	}
+	__groups[g].weight = weight;
+	return g;
+}
+
+/***********************************************************************
+ * Runnable groups in a min-heap of their virtual time
+ */
+static unsigned int __heap[MAX_GROUPS];
+static unsigned int __nr_heap = 0;
+
+static bool __before(unsigned int a, unsigned int b)
+{
+	if (__groups[a].vruntime != __groups[b].vruntime)
+		return __groups[a].vruntime < __groups[b].vruntime;
+	return a < b;
+}
+
+static void __heap_set(unsigned int i, unsigned int g)
+{
+	__heap[i] = g;
+	__groups[g].heap_index = i + 1;
+}
+
+static void __heap_fix(unsigned int i)
+{
+	unsigned int g = __heap[i];
+
+	while (i && __before(g, __heap[(i - 1) / 2])) {
+		__heap_set(i, __heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	while (2 * i + 1 < __nr_heap) {
+		unsigned int c = 2 * i + 1;
+
+		if (c + 1 < __nr_heap && __before(__heap[c + 1], __heap[c]))
+			c++;
+		if (!__before(__heap[c], g))
+			break;
+		__heap_set(i, __heap[c]);
+		i = c;
+	}
+	__heap_set(i, g);
+}
+
+/**
+ * Called by the ready queue as group @g gets its first ready process
+ */
+void __group_runnable(unsigned int g)
+{
+	if (__groups[g].heap_index)
+		return;
+
+	if (__groups[g].vruntime < __group_min_vruntime)
+		__groups[g].vruntime = __group_min_vruntime;
+	__heap_set(__nr_heap++, g);
+	__heap_fix(__nr_heap - 1);
+}
+
+/**
+ * Called by the ready queue as group @g runs out of ready processes
+ */
+void __group_idle(unsigned int g)
+{
+	unsigned int i = __groups[g].heap_index;
+
+	if (!i)
+		return;
+
+	__groups[g].heap_index = 0;
+	if (i - 1 != --__nr_heap) {
+		__heap_set(i - 1, __heap[__nr_heap]);
+		__heap_fix(i - 1);
+	}
+}
+
+/**
+ * Account the tick that @p has just run for its group. The tick is also
+ * divided among the runnable groups by their weights, which is the share
+ * each group was entitled to in the tick
+ */
+void __group_ran(struct process *p)
+{
+	struct __group *g = __groups + p->cold->__group;
+	unsigned long long weights = 0;
+
+	g->ran++;
+	if (__nr_groups == 1)
+		return;
+
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		if (__groups[i].nr_ready || __groups + i == g)
+			weights += __groups[i].weight;
+	}
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		if (__groups[i].nr_ready || __groups + i == g)
+			__groups[i].entitled += ((unsigned long long)__groups[i].weight << GROUP_SHARE_SHIFT) / weights;
+	}
+
+	g->vruntime += GROUP_MAX_WEIGHT / g->weight;
+	if (g->heap_index)
+		__heap_fix(g->heap_index - 1);
+}
+
+/***********************************************************************
+ * Two-level scheduler
+ *
+ * The top level picks the runnable group with the smallest virtual time,
+ * which advances by the inverse of the weight as the group runs, so the
+ * groups share the processor in proportion to their weights. The inner
+ * scheduler then picks the process in the group. Each group has its own
+ * ready queue, which is switched into @readyqueue for the inner scheduler.
+ * So the inner scheduler works as is, only seeing the processes in the group.
+ */
+static struct scheduler *__inner = NULL;
+static char __group_sched_name[128];
+
+static int __group_initialize(void)
+{
+	__ready_regroup();
+
+	if (__inner->initialize)
+		return __inner->initialize();
+	return 0;
+}
+
+static void __group_finalize(void)
+{
+	if (__inner->finalize)
+		__inner->finalize();
+}
+
+static struct process *__group_schedule(void)
+{
+	bool runnable = current && current->status == PROCESS_RUNNING &&
+			current->age < current->lifespan;
+	unsigned int next;
+
+	/* The current process is not in the ready queue, so is not its group */
+	if (__nr_heap && (!runnable || __before(__heap[0], current->cold->__group))) {
+		next = __heap[0];
+	} else {
+		next = current ? current->cold->__group : 0;
+	}
+
+	/* Preempt the current process in the other group */
+	if (current && current->cold->__group != next) {
+		if (runnable)
+			ready_enqueue(current);
+		current = NULL;
+	}
+
+	if (__group_min_vruntime < __groups[next].vruntime)
+		__group_min_vruntime = __groups[next].vruntime;
+
+	__ready_switch(next);
+	return __inner->schedule();
+}
+
+static struct scheduler __group_scheduler = {
+	.initialize = __group_initialize,
+	.finalize = __group_finalize,
+	.schedule = __group_schedule,
+};
+
+/**
+ * Run @inner in each group under the weighted fair share of the groups
+ */
+struct scheduler *__group_sched(struct scheduler *inner)
+{
+	__inner = inner;
+
+	snprintf(__group_sched_name, sizeof(__group_sched_name), "Groups + %s", inner->name);
+	__group_scheduler.name = __group_sched_name;
+	__group_scheduler.forked = inner->forked;
+	__group_scheduler.exiting = inner->exiting;
+	__group_scheduler.acquire = inner->acquire;
+	__group_scheduler.release = inner->release;
+	__group_scheduler.woken = inner->woken;
+
+	return &__group_scheduler;
+}
+
+/***********************************************************************
+ * Report the share of the processor each group got against the share it was
+ * entitled to while it was runnable
+ */
+void __group_report(void)
+{
+	unsigned long long ran = 0;
+	unsigned long long weights = 0;
+
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		ran += __groups[i].ran;
+		weights += __groups[i].weight;
+	}
+
+	printf("\nShare of the groups\n");
+	printf("%-16s %6s %8s %7s %7s %7s\n", "Group", "Weight", "Ticks", "Share", "Target", "Weight%");
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		struct __group *g = __groups + i;
+
+		printf("%-16s %6u %8llu %6.1f%% %6.1f%% %6.1f%%\n", g->name, g->weight, g->ran,
+		       ran ? 100.0 * g->ran / ran : 0.0,
+		       ran ? 100.0 * g->entitled / ran / (1ULL << GROUP_SHARE_SHIFT) : 0.0,
+		       100.0 * g->weight / weights);
+	}
+}
@@ -0,0 +1,133 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simulator.h"
+
+extern __thread unsigned int ticks;
+
+bool __report_inversion = false;
+unsigned int __starvation_ticks = 0;
+
+/**
+ * Priority inversion of a process blocked on a resource is measured in the
+ * ticks run by processes of lower original priorities meanwhile:
+ *
+ *   direct:     The process running was in a critical section (i.e., holding
+ *               some resource), so it was a lower-priority owner blocking
+ *               the waiter directly or through a priority ceiling.
+ *   unbounded:  The process running held no resource. It just preempted the
+ *               owner that the waiter was blocked behind.
+ *
+ * Instead of charging every blocked process at every tick, the ticks run
+ * are counted per original priority of the process running. A waiter of
+ * priority n takes a snapshot of the ticks run at priorities below n when it
+ * gets blocked, and is charged the difference when it acquires the resource.
+ */
+__thread struct __inversion __inversion = { 0 };
+
+static void __ran_below(unsigned int prio, unsigned long long ran[2])
+{
+	ran[0] = ran[1] = 0;
+	for (unsigned int i = 0; i < prio && i <= MAX_PRIO; i++) {
+		ran[0] += __inversion.ran[0][i];
+		ran[1] += __inversion.ran[1][i];
+	}
+}
+
+/**
+ * @p made a progress in this tick
+ */
+void __inversion_ran(struct process *p)
+{
+	bool holding = !list_empty(&p->cold->__resources_holding);
+
+	__inversion.ran[!holding][p->prio_orig <= MAX_PRIO ? p->prio_orig : MAX_PRIO]++;
+}
+
+/**
+ * @p is blocked on a resource. Called only for the first attempt, as the
+ * contention profile does
+ */
+void __inversion_blocked(struct process *p)
+{
+	__ran_below(p->prio_orig, p->cold->__inversion_mark);
+}
+
+void __inversion_acquired(struct process *p)
+{
+	unsigned long long ran[2];
+
+	__ran_below(p->prio_orig, ran);
+	p->cold->__inversion[0] += ran[0] - p->cold->__inversion_mark[0];
+	p->cold->__inversion[1] += ran[1] - p->cold->__inversion_mark[1];
+}
+
+/**
+ * @p is scheduled in after waiting in the ready queue
+ */
+void __inversion_dispatched(struct process *p)
+{
+	unsigned int wait = ticks - p->cold->__ready_at;
+
+	if (__stats.max_ready_wait < wait)
+		__stats.max_ready_wait = wait;
+
+	if (__starvation_ticks && wait > __starvation_ticks) {
+		p->cold->__nr_starved++;
+		__stats.nr_starved++;
+	}
+}
+
+void __inversion_exited(struct process *p)
+{
+	struct process_cold *cold = p->cold;
+
+	__stats.inversion += cold->__inversion[0];
+	__stats.unbounded_inversion += cold->__inversion[1];
+
+	if (!__report_inversion ||
+	    !(cold->__inversion[0] || cold->__inversion[1] || cold->__nr_starved))
+		return;
+
+	printf("%7d %5d %10u %10u %8u\n", p->pid, p->prio_orig,
+	       cold->__inversion[0], cold->__inversion[1], cold->__nr_starved);
+}
+
+/***********************************************************************
+ * Print the header of the report. The processes are listed as they exit
+ */
+void __inversion_start(void)
+{
+	if (!__report_inversion)
+		return;
+
+	printf("Priority inversion and starvation");
+	if (__starvation_ticks)
+		printf(" (starved if waiting more than %u ticks)", __starvation_ticks);
+	printf("\n%7s %5s %10s %10s %8s\n", "Process", "Prio", "Direct", "Unbounded", "Starved");
+}
+
+void __inversion_report(void)
+{
+	if (!__report_inversion)
+		return;
+
+	printf("%7s %5s %10llu %10llu %8llu\n", "Total", "", __stats.inversion,
+	       __stats.unbounded_inversion, __stats.nr_starved);
+	printf("Longest wait in the ready queue: %llu ticks\n", __stats.max_ready_wait);
+}
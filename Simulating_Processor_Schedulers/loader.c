@@ -0,0 +1,923 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/* For clock_gettime() */
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "parser.h"
+#include "simulator.h"
+
+extern bool quiet;
+extern struct resource resources[NR_RESOURCES];
+
+bool __report_load = false;
+unsigned int __nr_loaders = 0;
+
+/**
+ * Do not bother spawning a thread for a chunk smaller than this
+ */
+#define LOADER_MIN_CHUNK	(1 << 20)
+#define LOADER_MAX_THREADS	64
+
+/**
+ * Keywords in the process script
+ */
+enum __keyword {
+	KEYWORD_UNKNOWN,
+	KEYWORD_PROCESS,
+	KEYWORD_END,
+	KEYWORD_LIFESPAN,
+	KEYWORD_PRIO,
+	KEYWORD_START,
+	KEYWORD_ACQUIRE,
+	KEYWORD_IO,
+	KEYWORD_RESOURCE,
+	KEYWORD_GROUP,
+	KEYWORD_WORKINGSET,
+	KEYWORD_REPEAT,
+	KEYWORD_TEMPLATE,
+	KEYWORD_LIKE,
+	KEYWORD_SEED,
+};
+
+static enum __keyword __match_keyword(const struct token *token)
+{
+	const char *str = token->str;
+
+	switch (token->len) {
+	case 2:
+		if (!memcmp(str, "io", 2)) return KEYWORD_IO;
+		break;
+	case 3:
+		if (!memcmp(str, "end", 3)) return KEYWORD_END;
+		break;
+	case 4:
+		if (!memcmp(str, "prio", 4)) return KEYWORD_PRIO;
+		if (!memcmp(str, "like", 4)) return KEYWORD_LIKE;
+		if (!memcmp(str, "seed", 4)) return KEYWORD_SEED;
+		break;
+	case 5:
+		if (!memcmp(str, "start", 5)) return KEYWORD_START;
+		if (!memcmp(str, "group", 5)) return KEYWORD_GROUP;
+		break;
+	case 7:
+		if (!memcmp(str, "process", 7)) return KEYWORD_PROCESS;
+		if (!memcmp(str, "acquire", 7)) return KEYWORD_ACQUIRE;
+		break;
+	case 6:
+		if (!memcmp(str, "repeat", 6)) return KEYWORD_REPEAT;
+		break;
+	case 8:
+		if (!memcmp(str, "lifespan", 8)) return KEYWORD_LIFESPAN;
+		if (!memcmp(str, "resource", 8)) return KEYWORD_RESOURCE;
+		if (!memcmp(str, "template", 8)) return KEYWORD_TEMPLATE;
+		break;
+	case 10:
+		if (!memcmp(str, "workingset", 10)) return KEYWORD_WORKINGSET;
+		break;
+	}
+	return KEYWORD_UNKNOWN;
+}
+
+/**
+ * Tokens of the line in @tokens that are numbers, as the bits of the mask
+ */
+unsigned int __script_numbers(const struct token *tokens, int nr_tokens)
+{
+	switch (__match_keyword(tokens)) {
+	case KEYWORD_PROCESS:
+	case KEYWORD_LIFESPAN:
+	case KEYWORD_PRIO:
+	case KEYWORD_START:
+	case KEYWORD_WORKINGSET:
+		return 1U << 1;
+	case KEYWORD_ACQUIRE:
+		return 1U << 1 | 1U << 2 | 1U << 3;
+	case KEYWORD_IO:
+	case KEYWORD_RESOURCE:
+		return 1U << 1 | 1U << 2;
+	case KEYWORD_GROUP:
+		return nr_tokens == 3 ? 1U << 2 : 0;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * The script is split into chunks at the process lines and each chunk is
+ * parsed by a thread into its own arena. Processes are described in the arena
+ * first, and materialized into the process table after all chunks are parsed.
+ */
+struct __script_acquire {
+	unsigned int resource_id;	/* SCRIPT_IO for I/O */
+	unsigned long long at;		/* Times are in ns with --tick-ns */
+	unsigned long long duration;
+	bool shared;
+};
+
+#define SCRIPT_IO	((unsigned int)-1)
+
+struct __script_process {
+	unsigned int pid;
+	unsigned long long starts_at;
+	unsigned long long lifespan;
+	unsigned int prio;
+	unsigned int working_set;	/* KB */
+
+	size_t acquires;			/* Index of the first acquire/io in the arena */
+	unsigned int nr_acquires;
+
+	struct token group;			/* Name of the group. Empty for the default */
+
+	struct process *p;			/* Materialized process */
+};
+
+struct __chunk {
+	const char *begin;
+	const char *end;
+	pthread_t thread;
+
+	struct __script_process *procs;
+	size_t nr_procs;
+	size_t size_procs;
+
+	struct __script_acquire *acquires;
+	size_t nr_acquires;
+	size_t size_acquires;
+
+	unsigned int base;			/* The first slot in the process table */
+	unsigned int *order;		/* Indices of @procs in the order of the start time */
+	size_t next;				/* Next in @order to merge */
+
+	unsigned int capacity[NR_RESOURCES];
+								/* Capacities declared in the chunk. 0 if not */
+	struct {
+		struct token name;
+		unsigned int weight;
+	} groups[MAX_GROUPS];		/* Groups declared in the chunk */
+	unsigned int nr_groups;
+
+	struct token error;			/* The unknown property if any */
+	const char *reason;			/* What is wrong with @error. NULL if unknown */
+	bool extended;				/* Uses the extensions in expand.c */
+};
+
+static void *__grow(void *array, size_t *size, size_t elem_size)
+{
+	*size = *size ? *size * 2 : 64;
+	array = realloc(array, *size * elem_size);
+	assert(array);
+	return array;
+}
+
+/**
+ * Sort the processes in @c by the start time. As the radix sort is stable,
+ * the processes starting at the same tick remain in the order in the file
+ */
+#define RADIX_BITS	16
+
+static void __sort_chunk(struct __chunk *c)
+{
+	unsigned int *tmp;
+	size_t *count;
+	unsigned long long max = 0;
+	bool sorted = true;
+
+	c->order = malloc(sizeof(*c->order) * (c->nr_procs ? c->nr_procs : 1));
+	assert(c->order);
+
+	for (size_t i = 0; i < c->nr_procs; i++) {
+		c->order[i] = i;
+		if (c->procs[i].starts_at > max)
+			max = c->procs[i].starts_at;
+		if (i && c->procs[i].starts_at < c->procs[i - 1].starts_at)
+			sorted = false;
+	}
+	if (sorted)
+		return;
+
+	tmp = malloc(sizeof(*tmp) * c->nr_procs);
+	/* On the heap, not to take the stack or the TLS of every thread */
+	count = malloc(sizeof(*count) << RADIX_BITS);
+	assert(tmp && count);
+
+	for (unsigned int shift = 0; shift < 64 && (max >> shift); shift += RADIX_BITS) {
+		unsigned int *swap;
+		size_t sum = 0;
+
+		memset(count, 0x00, sizeof(*count) << RADIX_BITS);
+		for (size_t i = 0; i < c->nr_procs; i++) {
+			count[(c->procs[c->order[i]].starts_at >> shift) & ((1 << RADIX_BITS) - 1)]++;
+		}
+		for (size_t i = 0; i < (1 << RADIX_BITS); i++) {
+			size_t n = count[i];
+			count[i] = sum;
+			sum += n;
+		}
+		for (size_t i = 0; i < c->nr_procs; i++) {
+			unsigned int digit = (c->procs[c->order[i]].starts_at >> shift) & ((1 << RADIX_BITS) - 1);
+			tmp[count[digit]++] = c->order[i];
+		}
+		swap = c->order;
+		c->order = tmp;
+		tmp = swap;
+	}
+	free(count);
+	free(tmp);
+}
+
+/**
+ * Time in @token, in ticks or in ns with --tick-ns
+ */
+static unsigned long long __time(const struct token *token)
+{
+	unsigned long long ns;
+
+	if (!__tick_ns)
+		return token_to_int(token);
+
+	token_to_ns(token, __tick_ns, &ns);
+	return ns;
+}
+
+/**
+ * Parse a line into the arena of @c. @p is the process being described.
+ * Returns the keyword of the line, or KEYWORD_UNKNOWN with @c->error set
+ */
+static enum __keyword __parse_line(struct __chunk *c, struct __script_process **p,
+				   const struct token *tokens, int nr_tokens)
+{
+	enum __keyword keyword = __match_keyword(tokens);
+
+	switch (keyword) {
+	case KEYWORD_PROCESS:
+		assert(nr_tokens == 2);
+		/**
+		 * Start processor description. A process not closed with
+		 * end is discarded, so is the one overwritten here
+		 */
+		if (*p) {
+			c->nr_procs--;
+			c->nr_acquires = (*p)->acquires;
+		}
+		if (c->nr_procs == c->size_procs)
+			c->procs = __grow(c->procs, &c->size_procs, sizeof(*c->procs));
+		*p = c->procs + c->nr_procs++;
+		**p = (struct __script_process) {
+			.pid = token_to_int(tokens + 1),
+			.acquires = c->nr_acquires,
+		};
+		break;
+
+	case KEYWORD_END:
+		/* End of process description */
+		assert(*p);
+		*p = NULL;
+		break;
+
+	case KEYWORD_LIFESPAN:
+		assert(nr_tokens == 2);
+		assert(*p);
+		(*p)->lifespan = __time(tokens + 1);
+		break;
+	case KEYWORD_PRIO:
+		assert(nr_tokens == 2);
+		assert(*p);
+		(*p)->prio = token_to_int(tokens + 1);
+		if ((*p)->prio > MAX_PRIO) {
+			c->error = tokens[1];
+			c->reason = "Invalid priority";
+			return KEYWORD_UNKNOWN;
+		}
+		break;
+	case KEYWORD_START:
+		assert(nr_tokens == 2);
+		assert(*p);
+		(*p)->starts_at = __time(tokens + 1);
+		break;
+	case KEYWORD_WORKINGSET:
+		assert(nr_tokens == 2);
+		assert(*p);
+		(*p)->working_set = token_to_int(tokens + 1);
+		break;
+	case KEYWORD_ACQUIRE:
+		assert(nr_tokens == 4 || nr_tokens == 5);
+		assert(*p);
+		if (c->nr_acquires == c->size_acquires)
+			c->acquires = __grow(c->acquires, &c->size_acquires, sizeof(*c->acquires));
+		c->acquires[c->nr_acquires++] = (struct __script_acquire) {
+			.resource_id = token_to_int(tokens + 1),
+			.at = __time(tokens + 2),
+			.duration = __time(tokens + 3),
+		};
+		(*p)->nr_acquires++;
+
+		/* Optional mode of the acquisition */
+		if (nr_tokens == 5) {
+			if (tokens[4].len == 6 && !memcmp(tokens[4].str, "shared", 6)) {
+				c->acquires[c->nr_acquires - 1].shared = true;
+			} else if (tokens[4].len != 9 || memcmp(tokens[4].str, "exclusive", 9)) {
+				c->error = tokens[4];
+				return KEYWORD_UNKNOWN;
+			}
+		}
+		break;
+	case KEYWORD_IO:
+		assert(nr_tokens == 3);
+		assert(*p);
+		if (c->nr_acquires == c->size_acquires)
+			c->acquires = __grow(c->acquires, &c->size_acquires, sizeof(*c->acquires));
+		c->acquires[c->nr_acquires++] = (struct __script_acquire) {
+			.resource_id = SCRIPT_IO,
+			.at = __time(tokens + 1),
+			.duration = __time(tokens + 2),
+		};
+		(*p)->nr_acquires++;
+		break;
+	case KEYWORD_RESOURCE: {
+		unsigned int id = token_to_int(tokens + 1);
+
+		assert(nr_tokens == 3);
+		assert(id < NR_RESOURCES);
+		c->capacity[id] = token_to_int(tokens + 2);
+		assert(c->capacity[id] > 0);
+		break;
+	}
+	case KEYWORD_GROUP:
+		if (tokens[1].len >= GROUP_NAME_LEN) {
+			c->error = tokens[1];
+			c->reason = "Too long group name";
+			return KEYWORD_UNKNOWN;
+		}
+		if (nr_tokens == 2) {
+			/* The group of the process */
+			assert(*p);
+			(*p)->group = tokens[1];
+		} else {
+			/* Declaration of a group */
+			assert(nr_tokens == 3);
+			assert(c->nr_groups < MAX_GROUPS);
+			c->groups[c->nr_groups].name = tokens[1];
+			c->groups[c->nr_groups].weight = token_to_int(tokens + 2);
+			c->nr_groups++;
+		}
+		break;
+
+	default:
+		c->error = tokens[0];
+		break;
+	}
+	return keyword;
+}
+
+/**
+ * Whether the line uses the extensions in expand.c, which are expanded only
+ * in the streaming mode. A process is being described if @in_process
+ */
+static bool __extended(const struct token *tokens, int nr_tokens, bool in_process)
+{
+	unsigned int numbers = __script_numbers(tokens, nr_tokens);
+
+	switch (__match_keyword(tokens)) {
+	case KEYWORD_REPEAT:
+	case KEYWORD_TEMPLATE:
+	case KEYWORD_LIKE:
+	case KEYWORD_SEED:
+		return true;
+	case KEYWORD_PROCESS:
+		if (nr_tokens != 2)
+			return true;
+		break;
+	case KEYWORD_END:
+		/* Closing a repeat split off into another chunk */
+		return !in_process;
+	default:
+		break;
+	}
+
+	for (int i = 1; i < nr_tokens; i++) {
+		const struct token *t = tokens + i;
+		unsigned int j = t->len && t->str[0] == '-';
+		unsigned long long ns;
+
+		if (!(numbers & (1U << i)))
+			continue;
+		if (__tick_ns && token_to_ns(t, __tick_ns, &ns))
+			continue;
+		if (j == t->len)
+			return true;
+		for (; j < t->len; j++) {
+			if (t->str[j] < '0' || t->str[j] > '9')
+				return true;
+		}
+	}
+	return false;
+}
+
+static void *__parse_chunk(void *arg)
+{
+	struct __chunk *c = arg;
+	struct __script_process *p = NULL;
+	const char *curr = c->begin;
+
+	while (curr < c->end) {
+		struct token tokens[MAX_NR_TOKENS];
+		int nr_tokens;
+
+		curr = scan_line(curr, c->end, tokens, &nr_tokens);
+
+		if (nr_tokens == 0)
+			continue;
+
+		if (nr_tokens < 0) {
+			c->error = tokens[0];
+			c->reason = "Too many tokens in the line of";
+			return NULL;
+		}
+
+		if (__extended(tokens, nr_tokens, p)) {
+			c->extended = true;
+			return NULL;
+		}
+
+		if (__parse_line(c, &p, tokens, nr_tokens) == KEYWORD_UNKNOWN)
+			return NULL;
+	}
+	if (p) {
+		c->nr_procs--;
+		c->nr_acquires = p->acquires;
+	}
+
+	__sort_chunk(c);
+
+	return NULL;
+}
+
+/**
+ * Find the beginning of the first process line at or after @curr
+ */
+static const char *__next_boundary(const char *curr, const char *begin, const char *end)
+{
+	if (curr > begin && curr < end && curr[-1] != '\n') {
+		const char *eol = memchr(curr, '\n', end - curr);
+		curr = eol ? eol + 1 : end;
+	}
+
+	while (curr < end) {
+		struct token tokens[MAX_NR_TOKENS];
+		const char *next;
+		int nr_tokens;
+
+		next = scan_line(curr, end, tokens, &nr_tokens);
+		if (nr_tokens && __match_keyword(tokens) == KEYWORD_PROCESS)
+			return curr;
+		curr = next;
+	}
+	return end;
+}
+
+static void __briefing_schedule(struct process *p)
+{
+	struct resource_schedule *rs;
+	struct io_schedule *io;
+
+	if (__tick_ns) {
+		printf("- Process %d: Forked at %llu ns and run for %llu ns with initial priority %d\n",
+		       p->pid, p->cold->__ns_starts_at, p->cold->__ns_lifespan, p->prio);
+	} else {
+		printf("- Process %d: Forked at tick %d and run for %d tick%s with initial priority %d\n",
+		       p->pid, p->cold->__starts_at, p->lifespan, p->lifespan >= 2 ? "s" : "", p->prio);
+	}
+
+	list_for_each_entry(rs, &p->cold->__resources_to_acquire, list) {
+		if (__tick_ns) {
+			printf("    Acquire resource [%d] at %llu for %llu%s\n", rs->resource_id,
+			       rs->at_ns, rs->duration_ns, rs->shared ? " shared" : "");
+			continue;
+		}
+		printf("    Acquire resource [%d] at %d for %d%s\n", rs->resource_id, rs->at,
+		       rs->duration, rs->shared ? " shared" : "");
+	}
+	list_for_each_entry(io, &p->cold->__io_to_do, list) {
+		if (__tick_ns) {
+			printf("    Perform I/O at %llu for %llu\n", io->at_ns, io->duration_ns);
+			continue;
+		}
+		printf("    Perform I/O at %d for %d\n", io->at, io->duration);
+	}
+	if (p->cold->__group)
+		printf("    In group %s\n", __groups[p->cold->__group].name);
+	if (p->cold->__working_set)
+		printf("    Working set of %u KB\n", p->cold->__working_set);
+}
+
+/**
+ * Ticks of time @t in the script, rounded up if @up. @t is in ns with
+ * --tick-ns, and in ticks already otherwise
+ */
+static unsigned int __ticks_of(unsigned long long t, bool up)
+{
+	if (!__tick_ns)
+		return t;
+	return (t + (up ? __tick_ns - 1 : 0)) / __tick_ns;
+}
+
+/**
+ * Materialize @sp into @p. Returns false with @c->error set if @sp is in an
+ * undeclared group
+ */
+static bool __materialize(struct __chunk *c, struct __script_process *sp, struct process *p)
+{
+	p->pid = sp->pid;
+	p->lifespan = __ticks_of(sp->lifespan, true);
+	p->prio = p->prio_orig = sp->prio;
+	p->cold->__starts_at = __ticks_of(sp->starts_at, false);
+	p->cold->__working_set = sp->working_set;
+
+	if (__tick_ns) {
+		p->cold->__ns_starts_at = sp->starts_at;
+		p->cold->__ns_lifespan = sp->lifespan;
+	}
+
+	if (sp->group.len) {
+		int g = __group_lookup(sp->group.str, sp->group.len);
+
+		if (g < 0) {
+			c->error = sp->group;
+			return false;
+		}
+		p->cold->__group = g;
+	}
+
+	for (unsigned int i = 0; i < sp->nr_acquires; i++) {
+		struct __script_acquire *a = c->acquires + sp->acquires + i;
+		struct resource_schedule *rs;
+
+		if (a->resource_id == SCRIPT_IO) {
+			struct io_schedule *io = malloc(sizeof(*io));
+
+			*io = (struct io_schedule) {
+				.at = __ticks_of(a->at, false),
+				.duration = __ticks_of(a->duration, true),
+				.at_ns = __tick_ns ? a->at : 0,
+				.duration_ns = __tick_ns ? a->duration : 0,
+			};
+			list_add_tail(&io->list, &p->cold->__io_to_do);
+			continue;
+		}
+
+		rs = malloc(sizeof(*rs));
+		*rs = (struct resource_schedule) {
+			.resource_id = a->resource_id,
+			.at = __ticks_of(a->at, false),
+			.duration = __ticks_of(a->duration, true),
+			.at_ns = __tick_ns ? a->at : 0,
+			.duration_ns = __tick_ns ? a->duration : 0,
+			.shared = a->shared,
+		};
+		list_add_tail(&rs->list, &p->cold->__resources_to_acquire);
+	}
+	sp->p = p;
+	return true;
+}
+
+/**
+ * Materialize the processes of @c into the slots reserved for the chunk
+ */
+static void *__materialize_chunk(void *arg)
+{
+	struct __chunk *c = arg;
+
+	for (size_t i = 0; i < c->nr_procs; i++) {
+		if (!__materialize(c, c->procs + i, __init_process(c->base + i)))
+			break;
+	}
+	return NULL;
+}
+
+/**
+ * Run @fn for each chunk in parallel. The first chunk is processed by this
+ * thread
+ */
+static void __run_chunks(struct __chunk *chunks, unsigned int nr_chunks, void *(*fn)(void *))
+{
+	for (unsigned int i = 1; i < nr_chunks; i++) {
+		if (pthread_create(&chunks[i].thread, NULL, fn, chunks + i)) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	fn(chunks);
+	for (unsigned int i = 1; i < nr_chunks; i++) {
+		pthread_join(chunks[i].thread, NULL);
+	}
+}
+
+/**
+ * Merge the chunks into @__forkqueue in the order of the start time. The
+ * processes starting at the same tick are ordered by their position in the
+ * file, so the result does not depend on how the script is split.
+ */
+static void __merge_chunks(struct __chunk *chunks, unsigned int nr_chunks)
+{
+	while (true) {
+		struct __chunk *best = NULL;
+
+		for (unsigned int i = 0; i < nr_chunks; i++) {
+			struct __chunk *c = chunks + i;
+
+			if (c->next == c->nr_procs)
+				continue;
+			if (!best || c->procs[c->order[c->next]].starts_at <
+				     best->procs[best->order[best->next]].starts_at)
+				best = c;
+		}
+		if (!best)
+			break;
+
+		list_add_tail(&best->procs[best->order[best->next++]].p->list, &__forkqueue);
+	}
+}
+
+/**
+ * Apply the capacities declared in @c. A later declaration overrides
+ */
+static void __set_capacities(struct __chunk *c)
+{
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		if (c->capacity[i])
+			resources[i].capacity = c->capacity[i];
+	}
+}
+
+/**
+ * Declare the groups declared in @c. A later declaration overrides
+ */
+static bool __declare_groups(struct __chunk *c)
+{
+	for (unsigned int i = 0; i < c->nr_groups; i++) {
+		if (__group_declare(c->groups[i].name.str, c->groups[i].name.len,
+				    c->groups[i].weight) < 0) {
+			fprintf(stderr, "Too many groups\n");
+			return false;
+		}
+	}
+	c->nr_groups = 0;
+	return true;
+}
+
+static void __briefing_groups(void)
+{
+	for (unsigned int i = 0; i < __nr_groups; i++) {
+		if (i || __groups[i].weight != 1)
+			printf("- Group %s: Weight of %u\n", __groups[i].name, __groups[i].weight);
+	}
+}
+
+static void __briefing_capacities(void)
+{
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		if (resources[i].capacity != 1)
+			printf("- Resource [%d]: Capacity of %u\n", i, resources[i].capacity);
+	}
+}
+
+static double __now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/***********************************************************************
+ * Load the process script
+ *
+ * DESCRIPTION
+ *   Map the script and scan it in place. The script is parsed on
+ *   @__nr_loaders threads (# of online processors if 0) when it is large.
+ *   Processes are put into @__forkqueue in the order of their start time,
+ *   and then in the order in the script. A script using the extensions in
+ *   expand.c is streamed instead, as it can describe more processes than
+ *   fit into the memory.
+ */
+bool __load_script(const char *filename)
+{
+	struct stat st;
+	const char *script = NULL;
+	struct __chunk chunks[LOADER_MAX_THREADS] = { 0 };
+	unsigned int nr_chunks = __nr_loaders;
+	double start = __now();
+	bool ret = true;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror(filename);
+		return false;
+	}
+	if (st.st_size) {
+		script = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (script == MAP_FAILED) {
+			perror(filename);
+			close(fd);
+			return false;
+		}
+	}
+	close(fd);
+
+	if (!nr_chunks) {
+		long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		nr_chunks = st.st_size / LOADER_MIN_CHUNK + 1;
+		if (nr_cpus > 0 && nr_chunks > nr_cpus)
+			nr_chunks = nr_cpus;
+	}
+	if (nr_chunks > LOADER_MAX_THREADS)
+		nr_chunks = LOADER_MAX_THREADS;
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		const char *from = i ? chunks[i - 1].end : script;
+		const char *to = script + st.st_size / nr_chunks * (i + 1);
+
+		chunks[i].begin = from;
+		chunks[i].end = i == nr_chunks - 1 ? script + st.st_size :
+				__next_boundary(to > from ? to : from, script, script + st.st_size);
+	}
+
+	__run_chunks(chunks, nr_chunks, __parse_chunk);
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		if (chunks[i].extended) {
+			/* Expanded as the simulation goes on, not to hold it all at once */
+			ret = __stream_script(filename);
+			goto out;
+		}
+	}
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		if (chunks[i].error.str) {
+			fprintf(stderr, "%s %.*s\n", chunks[i].reason ? chunks[i].reason : "Unknown property",
+				chunks[i].error.len, chunks[i].error.str);
+			ret = false;
+			goto out;
+		}
+	}
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		if (!__declare_groups(chunks + i)) {
+			ret = false;
+			goto out;
+		}
+	}
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		chunks[i].base = __reserve_processes(chunks[i].nr_procs);
+	}
+	__run_chunks(chunks, nr_chunks, __materialize_chunk);
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		if (chunks[i].error.str) {
+			fprintf(stderr, "Unknown group %.*s\n", chunks[i].error.len, chunks[i].error.str);
+			ret = false;
+			goto out;
+		}
+	}
+
+	__merge_chunks(chunks, nr_chunks);
+
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		__set_capacities(chunks + i);
+	}
+
+	if (!quiet) {
+		__briefing_groups();
+		__briefing_capacities();
+		for (unsigned int i = 0; i < nr_chunks; i++) {
+			for (size_t j = 0; j < chunks[i].nr_procs; j++) {
+				__briefing_schedule(chunks[i].procs[j].p);
+			}
+		}
+		printf("\n");
+	}
+
+	if (__report_load) {
+		double elapsed = __now() - start;
+
+		printf("Loaded %lld bytes on %u thread%s in %.3f ms (%.1f MB/s)\n\n",
+		       (long long)st.st_size, nr_chunks, nr_chunks >= 2 ? "s" : "",
+		       elapsed * 1e3, elapsed > 0 ? st.st_size / elapsed / 1e6 : 0.0);
+	}
+
+out:
+	for (unsigned int i = 0; i < nr_chunks; i++) {
+		free(chunks[i].procs);
+		free(chunks[i].acquires);
+		free(chunks[i].order);
+	}
+	if (script)
+		munmap((void *)script, st.st_size);
+
+	return ret;
+}
+
+/***********************************************************************
+ * Streaming mode
+ *
+ * The script is read line by line while the simulation goes on, so only the
+ * processes that have been forked and not exited yet are in memory. The
+ * processes should be listed in the order of the start time; a process
+ * listed after its start time is forked as soon as it is read. The lines are
+ * taken from expand.c with the extensions to the script expanded.
+ */
+static struct {
+	struct __chunk arena;		/* Holds the process being read */
+	char group[GROUP_NAME_LEN];	/* Group of the process being read */
+} __stream;
+
+static struct process *__stream_script_next(void)
+{
+	struct __script_process *sp = NULL;
+	struct token tokens[MAX_NR_TOKENS];
+	int nr_tokens;
+
+	while (__expand_line(tokens, &nr_tokens)) {
+		switch (__parse_line(&__stream.arena, &sp, tokens, nr_tokens)) {
+		case KEYWORD_END: {
+			struct process *p = __alloc_process();
+
+			if (!__materialize(&__stream.arena, __stream.arena.procs, p)) {
+				fprintf(stderr, "Unknown group %.*s\n",
+					__stream.arena.error.len, __stream.arena.error.str);
+				exit(EXIT_FAILURE);
+			}
+			__stream.arena.nr_procs = 0;
+			__stream.arena.nr_acquires = 0;
+			return p;
+		}
+		case KEYWORD_RESOURCE:
+			__set_capacities(&__stream.arena);
+			break;
+		case KEYWORD_GROUP:
+			if (nr_tokens == 3) {
+				if (!__declare_groups(&__stream.arena))
+					exit(EXIT_FAILURE);
+			} else {
+				/* The line is overwritten by the following lines */
+				memcpy(__stream.group, tokens[1].str, tokens[1].len);
+				__stream.group[tokens[1].len] = '\0';
+				sp->group.str = __stream.group;
+			}
+			break;
+		case KEYWORD_UNKNOWN:
+			fprintf(stderr, "%s %.*s\n",
+				__stream.arena.reason ? __stream.arena.reason : "Unknown property",
+				__stream.arena.error.len, __stream.arena.error.str);
+			exit(EXIT_FAILURE);
+		default:
+			break;
+		}
+	}
+
+	free(__stream.arena.procs);
+	free(__stream.arena.acquires);
+	return NULL;
+}
+
+bool __stream_script(const char *filename)
+{
+	if (access(filename, R_OK)) {
+		perror(filename);
+		return false;
+	}
+	__expand_open(filename);
+	__stream_next = __stream_script_next;
+
+	if (!quiet)
+		printf("Streaming processes from %s\n\n", filename);
+	return true;
+}
@@ -0,0 +1,308 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __LOOP_H__
+#define __LOOP_H__
+
+/**
+ * The main loop of the simulation, written as a template to be specialised
+ * for each policy. The functions are always inlined into their callers along
+ * with the policy @s. sched.c runs the loop through @sched, calling back the
+ * policy through the function pointers as usual. policies.c instantiates the
+ * loop with a constant struct scheduler for each policy in pa2.c, so that the
+ * compiler resolves the callbacks, inlines them, and drops the ones left NULL
+ * along with their checks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "simulator.h"
+
+#ifndef __always_inline
+#define __always_inline	inline __attribute__((always_inline))
+#endif
+
+extern __thread struct process *current;
+extern __thread unsigned int ticks;
+extern bool quiet;
+
+/**
+ * The loops specialised in policies.c never run with -P, so they are compiled
+ * without the hooks timing the phases
+ */
+#ifdef __LOOP_SPECIALIZED
+#undef __phase_enter
+#undef __phase_leave
+#define __phase_enter(phase)	do { } while (0)
+#define __phase_leave(phase)	do { } while (0)
+#endif
+
+/**
+ * Fork process on schedule
+ */
+static __always_inline int __fork_on_schedule(const struct scheduler *s)
+{
+	int nr_forked = 0;
+	struct process *p, *tmp;
+
+	__phase_enter(PROFILE_FORK);
+
+	__fill_from_stream();
+
+	/* @__forkqueue is sorted by the start time */
+	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
+		if (p->cold->__starts_at > ticks)
+			break;
+
+		list_del_init(&p->list);
+		if (__admission && !__admit(p))
+			continue;
+
+		p->status = PROCESS_READY;
+		__log_event(EVENT_FORK, p->pid, 0);
+
+		/* I/O at 0 is started right away */
+		if (!__start_io(p, ticks))
+			ready_enqueue(p);
+
+		if (s->forked)
+			s->forked(p);
+		nr_forked++;
+	}
+
+	__phase_leave(PROFILE_FORK);
+	return nr_forked;
+}
+
+/**
+ * Exit the process
+ */
+static __always_inline void __exit_process(const struct scheduler *s, struct process *p)
+{
+	struct io_schedule *io, *tmp;
+
+	__phase_enter(PROFILE_EXIT);
+
+	/* Make sure the process is not attached to some list head */
+	assert(list_empty(&p->list));
+	assert(!p->cold->__ready_index);
+
+	/* Make sure the process is not holding any resource */
+	assert(list_empty(&p->cold->__resources_holding));
+
+	/* Make sure there is no pending resource to acquire */
+	assert(list_empty(&p->cold->__resources_to_acquire));
+
+	/* I/O scheduled at or after the lifespan is never performed */
+	list_for_each_entry_safe(io, tmp, &p->cold->__io_to_do, list) {
+		list_del(&io->list);
+		free(io);
+	}
+
+	if (s->exiting)
+		s->exiting(p);
+
+	__inversion_exited(p);
+
+	__log_event(EVENT_EXIT, p->pid, 0);
+
+	__stats.nr_exited++;
+	__stats.turnaround += ticks - p->cold->__starts_at;
+	__stats.waiting += ticks - p->cold->__starts_at - p->lifespan - p->cold->__io_ticks;
+	if (__stats.max_turnaround < ticks - p->cold->__starts_at)
+		__stats.max_turnaround = ticks - p->cold->__starts_at;
+
+	__free_process(p);
+
+	__phase_leave(PROFILE_EXIT);
+}
+
+/**
+ * Process resource acqutision
+ */
+static __always_inline bool __run_current_acquire(const struct scheduler *s)
+{
+	struct resource_schedule *rs, *tmp;
+
+	__phase_enter(PROFILE_ACQUIRE);
+
+	list_for_each_entry_safe(rs, tmp, &current->cold->__resources_to_acquire, list) {
+		if (rs->at == current->age) {
+			assert(s->acquire && "scheduler.acquire() not implemented");
+
+			/* Callback to acquire the resource */
+			current->cold->wants_shared = rs->shared;
+			if (!s->acquire(rs->resource_id)) {
+				if (!current->cold->__blocked_at)
+					__inversion_blocked(current);
+				__contention_blocked(current, rs);
+				__log_event(EVENT_BLOCKED, current->pid, rs->resource_id);
+				__phase_leave(PROFILE_ACQUIRE);
+				return false;
+			}
+			if (current->cold->__blocked_at)
+				__inversion_acquired(current);
+			__contention_acquired(current, rs);
+
+			list_move_tail(&rs->list, &current->cold->__resources_holding);
+
+			__log_event(EVENT_ACQUIRED, current->pid, rs->resource_id);
+		}
+	}
+
+	__phase_leave(PROFILE_ACQUIRE);
+	return true;
+}
+
+/**
+ * Process resource release
+ */
+static __always_inline void __run_current_release(const struct scheduler *s)
+{
+	struct resource_schedule *rs, *tmp;
+
+	__phase_enter(PROFILE_RELEASE);
+
+	list_for_each_entry_safe(rs, tmp, &current->cold->__resources_holding, list) {
+		if (--rs->duration != 0) {
+			continue;
+		}
+		assert(s->release && "scheduler.release() not implemented");
+
+		/* Callback the release() */
+		s->release(rs->resource_id);
+		__contention_released(rs);
+
+		__log_event(EVENT_RELEASED, current->pid, rs->resource_id);
+
+		list_del(&rs->list);
+		free(rs);
+	}
+
+	__phase_leave(PROFILE_RELEASE);
+}
+
+/***********************************************************************
+ * The main loop for the scheduler simulation with the policy @s
+ */
+static __always_inline void __simulate(const struct scheduler *s)
+{
+	assert(s->schedule && "scheduler.schedule() not implemented");
+
+	while (true) {
+		struct process *prev;
+
+		/* Save the state to resume the simulation from this tick later */
+		if (__checkpoint_file && ticks == __checkpoint_at) {
+			if (!__checkpoint_save(__checkpoint_file)) {
+				__log_sync();
+				fprintf(stderr, "Failed to save checkpoint %s\n", __checkpoint_file);
+			} else if (!quiet) {
+				printf("Saved checkpoint at tick %d to %s\n", ticks, __checkpoint_file);
+			}
+		}
+
+		/* Wake up the processes completing I/O */
+		__phase_enter(PROFILE_IO);
+		__timer_expire(ticks, __complete_io);
+		__phase_leave(PROFILE_IO);
+
+		/* Fork processes on schedule */
+		__fork_on_schedule(s);
+
+		/* Ask scheduler to pick the next process to run */
+		prev = current;
+		current = s->schedule(); /// 여기서 current 선택
+
+		if (current && current != prev)
+			__inversion_dispatched(current);
+
+		/* If the system has run a process in the previous tick */
+		if (prev) {
+			/* Update the process status */
+			if (prev->status == PROCESS_RUNNING) {
+				prev->status = PROCESS_READY;
+			} /// 전 process ready que 에 넣기
+
+			/* Decommission it if completed */
+			if (prev->age == prev->lifespan) {
+				prev->status = PROCESS_EXIT;
+				__exit_process(s, prev); /// 전 process 가 끝났 으면 해당 process 종료
+			}
+		}
+
+		/* No process is ready to run at this moment */
+		if (!current) { /// next == NULL
+			/* Quit simulation if no pending process exists */
+			if (!__ready_pending() && list_empty(&__forkqueue) &&
+			    !__timer_pending()) {
+				break;
+			}
+
+			/* Idle temporarily */
+			__log_event(EVENT_IDLE, 0, 0);
+			__stats.nr_idle++;
+		} else { /// next 가 선택 되면
+			/* Execute the current process */
+			current->status = PROCESS_RUNNING;
+
+			if (current != prev) {
+				if (!current->cold->__nr_dispatches)
+					__stats.response += ticks - current->cold->__starts_at;
+				current->cold->__nr_dispatches++;
+				__stats.nr_dispatches++;
+			}
+
+			if (current->cold->__woken_at)
+				__wake_dispatched(current);
+
+			/* Ensure that @current is detached from any list */
+			assert(list_empty(&current->list));
+
+			/* Try acquiring scheduled resources */
+			if (__run_current_acquire(s)) {
+				/* Succesfully acquired all the resources to make a progress */
+				__log_event(EVENT_RUN, current->pid, 0);
+
+				/* So, it ages by one tick */
+				current->age++;
+				__inversion_ran(current);
+				__group_ran(current);
+
+				/* And performs scheduled releases */
+				__run_current_release(s);
+
+				/* Then it may start I/O, which blocks it from the next tick */
+				if (current->age < current->lifespan)
+					__start_io(current, ticks + 1);
+			} else {
+				/**
+				 * The current is blocked while acquiring resource(s).
+				 * In this case, @current could not make a progress in this tick.
+				 * Thus, it does not get aged nor is unable to perform releases
+				 */
+			}
+		}
+
+		/* Increase the tick counter */
+		ticks++;
+	}
+
+	__stats.ticks = ticks;
+}
+
+#endif
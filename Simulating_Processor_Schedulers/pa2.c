@@ -24,12 +24,14 @@
  * The process which is currently running
  */
 #include "process.h"
-extern struct process *current;
+extern __thread struct process *current;
 
 /**
- * List head to hold the processes ready to run
+ * List head to hold the processes ready to run. Use the functions in ready.h
+ * to put processes into and take them out of the ready queue
  */
-extern struct list_head readyqueue;
+#include "ready.h"
+extern __thread struct list_head readyqueue;
 
 /**
  * Resources in the system.
@@ -40,7 +42,7 @@ extern struct resource resources[NR_RESOURCES];
 /**
  * Monotonically increasing ticks. Do not modify it
  */
-extern unsigned int ticks;
+extern __thread unsigned int ticks;
 
 /**
  * Quiet mode. True if the program was started with -q option
@@ -59,14 +61,15 @@ extern bool quiet;
 static bool fcfs_acquire(int resource_id)
 {
 	struct resource *r = resources + resource_id;
+	bool shared = current->cold->wants_shared;
 
-	if (!r->owner) {
-		/* This resource is not owned by any one. Take it! */
-		r->owner = current;
+	if (resource_available(r, shared)) {
+		/* This resource can be taken in the mode current wants. Take it! */
+		resource_get(r, current, shared);
 		return true;
 	}
 
-	/* OK, this resource is taken by @r->owner. */
+	/* OK, this resource is taken by @r->owners. */
 
 	/* Update the current process state */
 	current->status = PROCESS_BLOCKED;
@@ -82,6 +85,19 @@ static bool fcfs_acquire(int resource_id)
 	return false;
 }
 
+/**
+ * Put @waiter woken up from a waitqueue back into the ready queue
+ */
+static void fcfs_wake(struct process *waiter)
+{
+	/**
+	 * Put the waiter process into ready queue as woken up. The framework
+	 * ensures it is in the wait status, updates the status, and will
+	 * do the rest.
+	 */
+	ready_wake(waiter);
+}
+
 /***********************************************************************
  * Default FCFS resource release function
  *
@@ -91,42 +107,40 @@ static bool fcfs_acquire(int resource_id)
  *   The current implementation serves the resource in the requesting order
  *   without considering the priority. See the comments in sched.h
  ***********************************************************************/
+/**
+ * The waiter that came first among those who can take @r now
+ */
+static struct process *fcfs_first_waiter(struct resource *r)
+{
+	struct process *waiter;
+
+	list_for_each_entry(waiter, &r->waitqueue, list) {
+		if (resource_available(r, waiter->cold->wants_shared))
+			return waiter;
+	}
+	return NULL;
+}
+
 static void fcfs_release(int resource_id)
 {
 	struct resource *r = resources + resource_id;
 
 	/* Ensure that the owner process is releasing the resource */
-	assert(r->owner == current);
+	assert(resource_held_by(r, current));
 
 	/* Un-own this resource */
-	r->owner = NULL;
-
-	/* Let's wake up ONE waiter (if exists) that came first */
-	if (!list_empty(&r->waitqueue)) {
-		struct process *waiter = list_first_entry(&r->waitqueue, struct process, list);
-
-		/**
-		 * Ensure the waiter is in the wait status
-		 */
-		assert(waiter->status == PROCESS_BLOCKED);
+	resource_put(r, current);
 
-		/**
-		 * Take out the waiter from the waiting queue. Note we use
-		 * list_del_init() over list_del() to maintain the list head tidy
-		 * (otherwise, the framework will complain on the list head
-		 * when the process exits).
-		 */
-		list_del_init(&waiter->list);
-
-		/* Update the process status */
-		waiter->status = PROCESS_READY;
-
-		/**
-		 * Put the waiter process into ready queue. The framework will
-		 * do the rest.
-		 */
-		list_add_tail(&waiter->list, &readyqueue);
-	}
+	/**
+	 * Let's wake up the waiter (if exists) that came first among those who
+	 * can take the resource now. If it wants to share the resource, all the
+	 * other readers are woken up together, and the next writers are woken
+	 * up as long as the capacity of the resource allows. resource_wake()
+	 * takes them out of the waitqueue with list_del_init() over list_del()
+	 * to maintain the list head tidy (otherwise, the framework will complain
+	 * on the list head when the process exits).
+	 */
+	resource_wake(r, fcfs_first_waiter, fcfs_wake);
 }
 
 #include "sched.h"
@@ -167,8 +181,9 @@ pick_next:
 		 * Detach the process from the ready queue. Note that we use 
 		 * list_del_init() over list_del() to maintain the list head tidy.
 		 * Otherwise, the framework will complain (assert) on process exit.
+		 * ready_dequeue() does so while keeping the ready set in sync.
 		 */
-		list_del_init(&next->list);
+		ready_dequeue(next);
 	}
 	return next;
 }
@@ -189,8 +204,7 @@ struct scheduler fcfs_scheduler = {
 static struct process *sjf_schedule(void)
 {
     struct process* next = NULL;
-    struct process* test;
-    if(current == NULL){
+    if(current == NULL || current->status == PROCESS_BLOCKED){
         goto select;
     }
     if (current->age < current->lifespan) {
@@ -198,15 +212,8 @@ static struct process *sjf_schedule(void)
     }
     select:
     if(!list_empty(&readyqueue)){
-        next = list_first_entry(&readyqueue, struct process, list);
-        unsigned int shortest = next->lifespan;
-        list_for_each_entry(test, &readyqueue, list){
-            if(test->lifespan < shortest){
-                next = test;
-                shortest = next->lifespan;
-            }
-        }
-        list_del_init(&next->list);
+        next = ready_shortest_job();
+        ready_dequeue(next);
     }
     return next;
 }
@@ -223,24 +230,16 @@ struct scheduler sjf_scheduler = {
  ***********************************************************************/
 static struct process *stcf_schedule(void){
     struct process* next = NULL;
-    struct process* test;
-    if(current == NULL){ /// current 가 없음
+    if(current == NULL || current->status == PROCESS_BLOCKED){ /// current 가 없음
         goto select_non_current;
     }
     else{ /// current 가 있음
         if(!list_empty(&readyqueue)){
             if(current->lifespan - current->age > 0){
-                list_add_tail(&current->list, &readyqueue);
+                ready_enqueue(current);
             }
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int shortest = next->lifespan - next->age;
-            list_for_each_entry(test, &readyqueue, list){
-                if((test->lifespan - test->age) < shortest){
-                    next = test;
-                    shortest = next->lifespan - next->age;
-                }
-            }
-            list_del_init(&next->list);
+            next = ready_shortest_remaining();
+            ready_dequeue(next);
             return next;
         }
         else{
@@ -252,15 +251,8 @@ static struct process *stcf_schedule(void){
     }
     select_non_current:
     if(!list_empty(&readyqueue)){
-        next = list_first_entry(&readyqueue, struct process, list);
-        unsigned int shortest = next->lifespan;
-        list_for_each_entry(test, &readyqueue, list){
-            if(test->lifespan < shortest){
-                next = test;
-                shortest = next->lifespan;
-            }
-        }
-        list_del_init(&next->list);
+        next = ready_shortest_remaining();
+        ready_dequeue(next);
     }
     return next;
 }
@@ -277,20 +269,20 @@ struct scheduler stcf_scheduler = {
 
 static struct process *rr_schedule(void){
     struct process* next = NULL;
-    if(current == NULL){
+    if(current == NULL || current->status == PROCESS_BLOCKED){
         if(!list_empty(&readyqueue)){
             next = list_first_entry(&readyqueue, struct process, list);
-            list_del_init(&next->list);
+            ready_dequeue(next);
         }
         return next;
     }
     else{
         if(current->age < current->lifespan){
-            list_add_tail(&current->list, &readyqueue);
+            ready_enqueue(current);
         }
         if(!list_empty(&readyqueue)){
             next = list_first_entry(&readyqueue, struct process, list);
-            list_del_init(&next->list);
+            ready_dequeue(next);
             return next;
         }
         else{
@@ -310,100 +302,61 @@ struct scheduler rr_scheduler = {
  ***********************************************************************/
 static bool prio_acquire(int resource_id){
     struct resource *r = resources + resource_id;
-    if (!r->owner) {
-        r->owner = current;
+    if (resource_available(r, current->cold->wants_shared)) {
+        resource_get(r, current, current->cold->wants_shared);
         return true;
     }
     current->status = PROCESS_BLOCKED;
     list_add_tail(&current->list, &r->waitqueue);
     return false;
 }
-static void prio_release(int resource_id){
-    struct resource *r = resources + resource_id;
-    assert(r->owner == current);
-    r->owner = NULL;
-    if (!list_empty(&r->waitqueue)) {
-        struct process *waiter = list_first_entry(&r->waitqueue, struct process, list);
-        unsigned int highest = waiter->prio;
-        struct process* test;
-        list_for_each_entry(test, &r->waitqueue, list){
-            if(test->prio > highest){
-                waiter = test;
-                highest = waiter->prio;
-            }
+/**
+ * The waiter with the highest priority among those who can take @r now
+ */
+static struct process *prio_highest_waiter(struct resource *r){
+    struct process *waiter = NULL;
+    struct process *test;
+    list_for_each_entry(test, &r->waitqueue, list){
+        if(resource_available(r, test->cold->wants_shared) && (!waiter || test->prio > waiter->prio)){
+            waiter = test;
         }
-        assert(waiter->status == PROCESS_BLOCKED);
-        list_del_init(&waiter->list);
-        waiter->status = PROCESS_READY;
-        list_add_tail(&waiter->list, &readyqueue);
     }
+    return waiter;
+}
+static void prio_release(int resource_id){
+    struct resource *r = resources + resource_id;
+    assert(resource_held_by(r, current));
+    resource_put(r, current);
+    resource_wake(r, prio_highest_waiter, fcfs_wake);
+}
+/**
+ * Preempt the running process for a woken one with a higher priority
+ */
+static bool prio_woken(struct process *p){
+    return current && current->status == PROCESS_RUNNING && p->prio > current->prio;
 }
 
 static struct process *prio_schedule(void){
     struct process* next = NULL;
-    struct process* test;
     if(current == NULL || current->status == PROCESS_BLOCKED){
         if(!list_empty(&readyqueue)){
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int highest = next->prio;
-            list_for_each_entry(test, &readyqueue, list){
-                if(test->prio > highest){
-                    next = test;
-                    highest = next->prio;
-                }
-            }
-            list_del_init(&next->list);
+            next = ready_highest_prio();
+            ready_dequeue(next);
         }
         return next;
     }
-    else{
-        int check = 0;
-        unsigned int prior = current->prio;
-        list_for_each_entry(test, &readyqueue, list){
-            if(test->prio == prior){
-                check = 1;
-                break;
-            }
-        }
-
-        if(check == 0){ /// 같은 priority 을 가진 process 는 없음
-            if(current->age < current->lifespan){
-                list_add_tail(&current->list, &readyqueue);
-            }
-            if(!list_empty(&readyqueue)){
-                next = list_first_entry(&readyqueue, struct process, list);
-                unsigned int highest = next->prio;
-                list_for_each_entry(test, &readyqueue, list){
-                    if(test->prio > highest){
-                        next = test;
-                        highest = next->prio;
-                    }
-                }
-                list_del_init(&next->list);
-                return next;
-            }
-            return next;
-        }
-        else{ /// 같은 priority 을 가진 process 가 있음
-            if(current->age < current->lifespan){
-                list_add_tail(&current->list, &readyqueue);
-            }
-            if(!list_empty(&readyqueue)){
-                unsigned int highest = current->prio;
-                list_for_each_entry(test, &readyqueue, list){
-                    if(test->prio == highest){
-                        next = test;
-                        break;
-                    }
-                }
-                list_del_init(&next->list);
-                return next;
-            }
-            else{
-                return next;
-            }
-        }
+    /**
+     * Put current back to the tail so that it yields to the processes with
+     * the same priority, which come earlier in the ready queue
+     */
+    if(current->age < current->lifespan){
+        ready_enqueue(current);
     }
+    if(!list_empty(&readyqueue)){
+        next = ready_highest_prio();
+        ready_dequeue(next);
+    }
+    return next;
 }
 
 struct scheduler prio_scheduler = {
@@ -411,6 +364,7 @@ struct scheduler prio_scheduler = {
     .acquire = prio_acquire,
     .release = prio_release,
     .schedule = prio_schedule,
+    .woken = prio_woken,
 };
 
 /***********************************************************************
@@ -419,40 +373,23 @@ struct scheduler prio_scheduler = {
 
 static struct process *pa_schedule(void){
     struct process* next = NULL;
-    struct process* test;
     if(current == NULL || current->status == PROCESS_BLOCKED){
         if(!list_empty(&readyqueue)){
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int highest = next->prio;
-            list_for_each_entry(test, &readyqueue, list){
-                if(test->prio > highest){
-                    next = test;
-                    highest = next->prio;
-                }
-            }
-            list_del_init(&next->list);
+            next = ready_highest_prio();
+            ready_dequeue(next);
         }
         return next;
     }
     current->prio = current->prio_orig;
     if(!list_empty(&readyqueue)){
-        list_for_each_entry(test, &readyqueue, list){
-            test->prio++;
-        }
+        ready_age();
     }
     if(current->age < current->lifespan){
-        list_add_tail(&current->list, &readyqueue);
+        ready_enqueue(current);
     }
     if(!list_empty(&readyqueue)){
-        next = list_first_entry(&readyqueue, struct process, list);
-        unsigned int highest = next->prio;
-        list_for_each_entry(test, &readyqueue, list){
-            if(test->prio > highest){
-                next = test;
-                highest = next->prio;
-            }
-        }
-        list_del_init(&next->list);
+        next = ready_highest_prio();
+        ready_dequeue(next);
         return next;
     }
     return next;
@@ -463,187 +400,361 @@ struct scheduler pa_scheduler = {
     .acquire = prio_acquire,
     .release = prio_release,
     .schedule = pa_schedule,
+    .woken = prio_woken,
 };
 
 /***********************************************************************
  * Priority scheduler with priority ceiling protocol
  ***********************************************************************/
 
+/**
+ * The system ceiling, which is the highest ceiling among the resources held
+ * by the processes other than @p. @blocker is set to the resource raising
+ * the ceiling. Returns -1 when no other process holds a resource
+ */
+static int pcp_system_ceiling(struct process *p, struct resource **blocker){
+    int ceiling = -1;
+    for(int i = 0; i < NR_RESOURCES; i++){
+        struct resource *r = resources + i;
+        if(r->nr_owners > (unsigned int)resource_held_by(r, p) && (int)r->ceiling > ceiling){
+            ceiling = r->ceiling;
+            *blocker = r;
+        }
+    }
+    return ceiling;
+}
+
+static void pcp_push(struct process *p, int resource_id){
+    unsigned int prio = resources[resource_id].ceiling;
+    if(prio < p->prio) prio = p->prio;
+
+    assert(p->cold->nr_ceilings < NR_RESOURCES);
+    p->cold->ceilings[p->cold->nr_ceilings].resource_id = resource_id;
+    p->cold->ceilings[p->cold->nr_ceilings].prio = prio;
+    p->cold->nr_ceilings++;
+    p->prio = prio;
+    ready_update(p);
+}
+
+static void pcp_pop(struct process *p, int resource_id){
+    unsigned int i = p->cold->nr_ceilings;
+
+    /**
+     * Resources are usually released in the reverse order of acquisition,
+     * so the entry is found on the top. Otherwise refold the entries above
+     */
+    while(p->cold->ceilings[--i].resource_id != resource_id);
+    p->cold->nr_ceilings--;
+    for(; i < p->cold->nr_ceilings; i++){
+        unsigned int below = i ? p->cold->ceilings[i - 1].prio : p->prio_orig;
+        unsigned int id = p->cold->ceilings[i + 1].resource_id;
+        p->cold->ceilings[i].resource_id = id;
+        p->cold->ceilings[i].prio = resources[id].ceiling > below ? resources[id].ceiling : below;
+    }
+    p->prio = p->cold->nr_ceilings ? p->cold->ceilings[p->cold->nr_ceilings - 1].prio : p->prio_orig;
+    ready_update(p);
+}
+
 static bool pcp_acquire(int resource_id){
     struct resource *r = resources + resource_id;
-    if (!r->owner) {
-        r->owner = current;
-        r->owner->prio = MAX_PRIO;
+    struct resource *blocker = r;
+    /**
+     * A free resource is granted only if the priority is higher than the
+     * system ceiling. Otherwise wait for the resource raising the ceiling
+     */
+    if (resource_available(r, current->cold->wants_shared) &&
+        (int)current->prio > pcp_system_ceiling(current, &blocker)) {
+        resource_get(r, current, current->cold->wants_shared);
+        pcp_push(current, resource_id);
         return true;
     }
     current->status = PROCESS_BLOCKED;
-    list_add_tail(&current->list, &r->waitqueue);
+    current->cold->waiting_for = r;
+    list_add_tail(&current->list, &blocker->waitqueue);
     return false;
 }
+/**
+ * The waiter with the highest priority among those who wait for @r itself,
+ * not for the ceiling of @r, and can take it now
+ */
+static struct process *pcp_highest_waiter(struct resource *r){
+    struct process *waiter = NULL;
+    struct process *test;
+    list_for_each_entry(test, &r->waitqueue, list){
+        if(test->cold->waiting_for == r && resource_available(r, test->cold->wants_shared) &&
+           (!waiter || test->prio > waiter->prio)){
+            waiter = test;
+        }
+    }
+    return waiter;
+}
+static void pcp_wake(struct process *waiter){
+    waiter->cold->waiting_for = NULL;
+    ready_wake(waiter);
+}
 static void pcp_release(int resource_id){
     struct resource *r = resources + resource_id;
-    assert(r->owner == current);
-    r->owner->prio = r->owner->prio_orig;
-    r->owner = NULL;
-    if (!list_empty(&r->waitqueue)) {
-        struct process *waiter = list_first_entry(&r->waitqueue, struct process, list);
-        unsigned int highest = waiter->prio;
-        struct process* test;
-        list_for_each_entry(test, &r->waitqueue, list){
-            if(test->prio > highest){
-                waiter = test;
-                highest = waiter->prio;
-            }
+    struct process *test, *tmp;
+    assert(resource_held_by(r, current));
+    pcp_pop(current, resource_id);
+    resource_put(r, current);
+    /**
+     * Wake up the highest waiters for this resource, and all processes that
+     * were blocked by the ceiling of this resource to retry admission
+     */
+    resource_wake(r, pcp_highest_waiter, pcp_wake);
+    list_for_each_entry_safe(test, tmp, &r->waitqueue, list){
+        if(test->cold->waiting_for == r) continue;
+        list_del_init(&test->list);
+        pcp_wake(test);
+    }
+}
+/**
+ * Rebuild the ceiling stacks from the owners of the resources, which is
+ * required when the simulation is resumed from a checkpoint
+ */
+static int pcp_initialize(void){
+    for(int i = 0; i < NR_RESOURCES; i++){
+        for(unsigned int j = 0; j < resources[i].nr_owners; j++){
+            struct process *owner = resources[i].owners[j];
+            owner->cold->nr_ceilings = 0;
+            owner->prio = owner->prio_orig;
+            ready_update(owner);
         }
-        assert(waiter->status == PROCESS_BLOCKED);
-        list_del_init(&waiter->list);
-        waiter->status = PROCESS_READY;
-        list_add_tail(&waiter->list, &readyqueue);
     }
+    for(int i = 0; i < NR_RESOURCES; i++){
+        for(unsigned int j = 0; j < resources[i].nr_owners; j++)
+            pcp_push(resources[i].owners[j], i);
+    }
+    return 0;
 }
+
 static struct process *pcp_schedule(void){
     struct process* next = NULL;
-    struct process* test;
     if(current == NULL){
         if(!list_empty(&readyqueue)){
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int highest = next->prio;
-            list_for_each_entry(test, &readyqueue, list){
-                if(test->prio > highest){
-                    next = test;
-                    highest = next->prio;
-                }
-            }
-            list_del_init(&next->list);
+            next = ready_highest_prio();
+            ready_dequeue(next);
         }
         return next;
     }
     if(current->status == PROCESS_BLOCKED){
         if(!list_empty(&readyqueue)){
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int highest = next->prio;
-            list_for_each_entry(test, &readyqueue, list){
-                if(test->prio > highest){
-                    next = test;
-                    highest = next->prio;
-                }
-            }
-            list_del_init(&next->list);
-            next->prio = MAX_PRIO;
+            next = ready_highest_prio();
+            ready_dequeue(next);
         }
         return next;
     }
     if(current->age < current->lifespan){
-        list_add_tail(&current->list, &readyqueue);
+        ready_enqueue(current);
     }
     if(!list_empty(&readyqueue)){
-        next = list_first_entry(&readyqueue, struct process, list);
-        unsigned int highest = next->prio;
-        list_for_each_entry(test, &readyqueue, list){
-            if(test->prio > highest){
-                next = test;
-                highest = next->prio;
-            }
-        }
-        list_del_init(&next->list);
+        next = ready_highest_prio();
+        ready_dequeue(next);
         return next;
     }
     return next;
 }
 struct scheduler pcp_scheduler = {
 	.name = "Priority + PCP Protocol",
+    .initialize = pcp_initialize,
 	.acquire = pcp_acquire,
     .release = pcp_release,
     .schedule = pcp_schedule,
+    .woken = prio_woken,
 };
 
 /***********************************************************************
  * Priority scheduler with priority inheritance protocol
  ***********************************************************************/
+#define PRIO_MAP_WORDS	((MAX_PRIO + 64) / 64)
+
+/**
+ * Priorities of the processes waiting for each resource, counted per level.
+ * The highest waiter of a resource is donated to each of its owners, and an
+ * owner counts the donations from all of its resources in @prio_donated.
+ * Thus the effective priority is recomputed with a couple of bit scans
+ * instead of walking the waitqueues of every resource being held.
+ */
+static struct {
+    unsigned long long map[PRIO_MAP_WORDS];
+    unsigned int count[MAX_PRIO + 1];
+} pip_waiters[NR_RESOURCES];
+
+static int prio_map_max(const unsigned long long *map){
+    for(int i = PRIO_MAP_WORDS - 1; i >= 0; i--){
+        if(map[i])
+            return i * 64 + 63 - __builtin_clzll(map[i]);
+    }
+    return -1;
+}
+
+static void pip_donate(struct process *p, int prio){
+    if(prio < 0) return;
+    if(p->cold->prio_donated[prio]++ == 0)
+        p->cold->prio_donated_map[prio / 64] |= 1ULL << (prio % 64);
+}
+
+static void pip_undonate(struct process *p, int prio){
+    if(prio < 0) return;
+    assert(p->cold->prio_donated[prio] > 0);
+    if(--p->cold->prio_donated[prio] == 0)
+        p->cold->prio_donated_map[prio / 64] &= ~(1ULL << (prio % 64));
+}
+
+/**
+ * Move a waiter of @r from priority @from to @to (-1 for none). Returns true
+ * if the donation to the owners of @r has changed so that they should be
+ * updated
+ */
+static bool pip_requeue(struct resource *r, int from, int to){
+    int id = r - resources;
+    int top = prio_map_max(pip_waiters[id].map);
+    int new_top;
+
+    assert(to <= MAX_PRIO);
+    if(from >= 0 && --pip_waiters[id].count[from] == 0)
+        pip_waiters[id].map[from / 64] &= ~(1ULL << (from % 64));
+    if(to >= 0 && pip_waiters[id].count[to]++ == 0)
+        pip_waiters[id].map[to / 64] |= 1ULL << (to % 64);
+
+    new_top = prio_map_max(pip_waiters[id].map);
+    if(new_top == top || !r->nr_owners) return false;
+
+    for(unsigned int i = 0; i < r->nr_owners; i++){
+        pip_undonate(r->owners[i], top);
+        pip_donate(r->owners[i], new_top);
+    }
+    return true;
+}
+
+static void pip_update_owners(struct resource *r);
+
+/**
+ * Recompute the effective priority of @p and propagate the change along the
+ * owners that it is (transitively) waiting for
+ */
+static void pip_update(struct process *p){
+    int donated = prio_map_max(p->cold->prio_donated_map);
+    unsigned int prio = donated > (int)p->prio_orig ? (unsigned int)donated : p->prio_orig;
+    unsigned int old = p->prio;
+
+    if(prio == old) return;
+    p->prio = prio;
+    ready_update(p);
+
+    if(p->status != PROCESS_BLOCKED || !p->cold->waiting_for) return;
+    if(pip_requeue(p->cold->waiting_for, old, prio))
+        pip_update_owners(p->cold->waiting_for);
+}
+
+static void pip_update_owners(struct resource *r){
+    for(unsigned int i = 0; i < r->nr_owners; i++)
+        pip_update(r->owners[i]);
+}
+
+static void pip_wake(struct process *waiter){
+    struct resource *r = waiter->cold->waiting_for;
+    assert(waiter->status == PROCESS_BLOCKED);
+    if(pip_requeue(r, waiter->prio, -1))
+        pip_update_owners(r);
+    waiter->cold->waiting_for = NULL;
+    ready_wake(waiter);
+}
+
 static bool pip_acquire(int resource_id){
     struct resource *r = resources + resource_id;
-    if (!r->owner) {
-        r->owner = current;
+    if (resource_available(r, current->cold->wants_shared)) {
+        resource_get(r, current, current->cold->wants_shared);
+        /* Inherit the waiters left behind by the previous owner */
+        pip_donate(current, prio_map_max(pip_waiters[resource_id].map));
+        pip_update(current);
         return true;
     }
     current->status = PROCESS_BLOCKED;
-    if(r->owner->prio < current->prio)
-        r->owner->prio = current->prio;
+    current->cold->waiting_for = r;
     list_add_tail(&current->list, &r->waitqueue);
+    if(pip_requeue(r, -1, current->prio))
+        pip_update_owners(r);
     return false;
 }
 static void pip_release(int resource_id){
     struct resource *r = resources + resource_id;
-    assert(r->owner == current);
-    r->owner->prio = r->owner->prio_orig;
-    r->owner = NULL;
-    if (!list_empty(&r->waitqueue)) {
-        struct process *waiter = list_first_entry(&r->waitqueue, struct process, list);
-        unsigned int highest = waiter->prio;
-        struct process* test;
-        list_for_each_entry(test, &r->waitqueue, list){
-            if(test->prio > highest){
-                waiter = test;
-                highest = waiter->prio;
-            }
+    assert(resource_held_by(r, current));
+    pip_undonate(current, prio_map_max(pip_waiters[resource_id].map));
+    pip_update(current);
+    resource_put(r, current);
+    resource_wake(r, prio_highest_waiter, pip_wake);
+}
+/**
+ * Rebuild the donations from the waitqueues, which is required when the
+ * simulation is resumed from a checkpoint
+ */
+static int pip_initialize(void){
+    struct process *p;
+    for(int i = 0; i < NR_RESOURCES; i++){
+        for(int j = 0; j < PRIO_MAP_WORDS; j++)
+            pip_waiters[i].map[j] = 0;
+        for(int j = 0; j <= MAX_PRIO; j++)
+            pip_waiters[i].count[j] = 0;
+        for(unsigned int k = 0; k < resources[i].nr_owners; k++){
+            struct process *owner = resources[i].owners[k];
+            for(int j = 0; j < PRIO_MAP_WORDS; j++)
+                owner->cold->prio_donated_map[j] = 0;
+            for(int j = 0; j <= MAX_PRIO; j++)
+                owner->cold->prio_donated[j] = 0;
         }
-        assert(waiter->status == PROCESS_BLOCKED);
-        list_del_init(&waiter->list);
-        waiter->status = PROCESS_READY;
-        list_add_tail(&waiter->list, &readyqueue);
     }
+    for(int i = 0; i < NR_RESOURCES; i++){
+        list_for_each_entry(p, &resources[i].waitqueue, list){
+            p->cold->waiting_for = resources + i;
+            pip_requeue(resources + i, -1, p->prio);
+        }
+    }
+    for(int i = 0; i < NR_RESOURCES; i++){
+        pip_update_owners(resources + i);
+    }
+    return 0;
 }
+
 static struct process *pip_schedule(void){
     struct process* next = NULL;
-    struct process* test;
     if(current == NULL){
         if(!list_empty(&readyqueue)){
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int highest = next->prio;
-            list_for_each_entry(test, &readyqueue, list){
-                if(test->prio > highest){
-                    next = test;
-                    highest = next->prio;
-                }
-            }
-            list_del_init(&next->list);
+            next = ready_highest_prio();
+            ready_dequeue(next);
         }
         return next;
     }
     if(current->status == PROCESS_BLOCKED){
         if(!list_empty(&readyqueue)){
-            next = list_first_entry(&readyqueue, struct process, list);
-            unsigned int highest = next->prio;
-            list_for_each_entry(test, &readyqueue, list){
-                if(test->prio > highest){
-                    next = test;
-                    highest = next->prio;
-                }
-            }
-            list_del_init(&next->list);
+            next = ready_highest_prio();
+            ready_dequeue(next);
         }
         return next;
     }
     if(current->age < current->lifespan){
-        list_add_tail(&current->list, &readyqueue);
+        ready_enqueue(current);
     }
     if(!list_empty(&readyqueue)){
-        next = list_first_entry(&readyqueue, struct process, list);
-        unsigned int highest = next->prio;
-        list_for_each_entry(test, &readyqueue, list){
-            if(test->prio > highest){
-                next = test;
-                highest = next->prio;
-            }
-        }
-        list_del_init(&next->list);
+        next = ready_highest_prio();
+        ready_dequeue(next);
         return next;
     }
     return next;
 }
 struct scheduler pip_scheduler = {
 	.name = "Priority + PIP Protocol",
+    .initialize = pip_initialize,
     .acquire = pip_acquire,
     .release = pip_release,
     .schedule = pip_schedule,
+    .woken = prio_woken,
 };
+
+/**
+ * Built as a plugin exporting one of the schedulers above (make plugins)
+ */
+#ifdef PLUGIN
+SCHED_PLUGIN(PLUGIN);
+#endif
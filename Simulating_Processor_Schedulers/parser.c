@@ -51,3 +51,124 @@ int parse_command(char *command, char *tokens[])
 
 	return nr_tokens;
 }
+
+/**
+ * Same as isspace() in the C locale, but does not look up the locale table
+ */
+static inline bool __is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Scan the line starting at @curr in place without copying it. Tokens are
+ * separated by white spaces, and a token starting with # comments out the
+ * rest of the line as parse_command() does. @nr_tokens tells how many are in
+ * the line, or is -1 if there are more than MAX_NR_TOKENS, of which only the
+ * first MAX_NR_TOKENS are stored in @tokens.
+ *
+ * Returns the beginning of the next line, or @end if it was the last line.
+ */
+const char *scan_line(const char *curr, const char *end, struct token tokens[], int *nr_tokens)
+{
+	int nr = 0;
+
+	while (curr < end && *curr != '\n') {
+		const char *start;
+
+		if (__is_space(*curr)) {
+			curr++;
+			continue;
+		}
+		if (*curr == '#') {
+			const char *eol = memchr(curr, '\n', end - curr);
+			curr = eol ? eol : end;
+			break;
+		}
+
+		if (nr == MAX_NR_TOKENS) {
+			const char *eol = memchr(curr, '\n', end - curr);
+			curr = eol ? eol : end;
+			nr = -1;
+			break;
+		}
+
+		start = curr;
+		while (curr < end && !__is_space(*curr)) {
+			curr++;
+		}
+		tokens[nr].str = start;
+		tokens[nr].len = curr - start;
+		nr++;
+	}
+
+	*nr_tokens = nr;
+	return curr < end ? curr + 1 : end;
+}
+
+/**
+ * Convert @token to an integer as atoi() does; an optional sign followed by
+ * digits, ignoring the trailing non-digits
+ */
+int token_to_int(const struct token *token)
+{
+	const char *curr = token->str;
+	const char *end = token->str + token->len;
+	bool negative = false;
+	unsigned int value = 0;
+
+	if (curr < end && (*curr == '-' || *curr == '+')) {
+		negative = *curr == '-';
+		curr++;
+	}
+	for (; curr < end && *curr >= '0' && *curr <= '9'; curr++) {
+		value = value * 10 + (*curr - '0');
+	}
+
+	return negative ? -value : value;
+}
+
+/**
+ * Convert @token to nanoseconds. The token is a number with an optional
+ * fraction, followed by a unit of ns, us, ms or s, or by none for the ticks
+ * of @tick_ns each. Returns false if the token is not in the form, in which
+ * case @ns is converted from the leading part as token_to_int() does
+ */
+bool token_to_ns(const struct token *token, unsigned long long tick_ns, unsigned long long *ns)
+{
+	static const struct {
+		const char *str;
+		unsigned long long ns;
+	} units[] = {
+		{ "ns", 1 }, { "us", 1000 }, { "ms", 1000000 }, { "s", 1000000000 },
+	};
+	const char *curr = token->str;
+	const char *end = token->str + token->len;
+	unsigned long long value = 0, scale = 1, unit = tick_ns;
+	unsigned int nr_digits = 0;
+	bool valid;
+
+	for (; curr < end && *curr >= '0' && *curr <= '9'; curr++, nr_digits++) {
+		value = value * 10 + (*curr - '0');
+	}
+	if (curr < end && *curr == '.') {
+		for (curr++; curr < end && *curr >= '0' && *curr <= '9'; curr++, nr_digits++) {
+			if (scale < 1000000000ULL) {
+				value = value * 10 + (*curr - '0');
+				scale *= 10;
+			}
+		}
+	}
+	valid = nr_digits && curr == end;
+
+	for (unsigned int i = 0; i < sizeof(units) / sizeof(*units) && !valid && nr_digits; i++) {
+		if ((size_t)(end - curr) == strlen(units[i].str) &&
+		    !memcmp(curr, units[i].str, end - curr)) {
+			unit = units[i].ns;
+			valid = true;
+		}
+	}
+
+	*ns = value * unit / scale;
+	return valid;
+}
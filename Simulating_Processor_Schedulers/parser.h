@@ -16,10 +16,24 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+#include <stdbool.h>
+
 #define MAX_NR_TOKENS	32		/* Maximum length of tokens in a command */
 #define MAX_TOKEN_LEN	128		/* Maximum length of single token */
 #define MAX_COMMAND_LEN	1024	/* Maximum length of assembly string */
 
 int parse_command(char *command, char *tokens[]);
 
+/**
+ * A token pointing into the script being scanned. It is NOT NUL-terminated
+ */
+struct token {
+	const char *str;
+	unsigned int len;
+};
+
+const char *scan_line(const char *curr, const char *end, struct token tokens[], int *nr_tokens);
+int token_to_int(const struct token *token);
+bool token_to_ns(const struct token *token, unsigned long long tick_ns, unsigned long long *ns);
+
 #endif
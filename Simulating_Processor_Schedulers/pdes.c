@@ -0,0 +1,742 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/* For posix_memalign() */
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "simulator.h"
+#include "ready.h"
+#include "loop.h"
+
+extern __thread struct list_head readyqueue;
+
+unsigned int __nr_partitions = 0;
+unsigned int __nr_threads = 0;
+unsigned int __lookahead = 1;
+
+/**
+ * Parallel simulation of the partitions of the CPUs
+ *
+ * The CPUs are split into @__nr_partitions partitions of consecutive CPUs,
+ * each with its own ready queue, and the partitions are simulated on
+ * @__nr_threads threads. The threads simulate their partitions for a window
+ * of ticks, and then meet at a barrier. What the partitions share is done on
+ * the main thread at the barriers, in the order of the partitions:
+ *
+ *  - Forking processes into the least loaded partitions, and waking up the
+ *    processes completing I/O.
+ *  - Running the CPUs on which the processes acquire or release resources,
+ *    as the resources and the callbacks of the scheduler on them are shared.
+ *  - Starting I/O and exiting processes.
+ *  - Pushing the events logged by the partitions into the log.
+ *  - Delivering the processes posted between the partitions from the outbox
+ *    of the sender to the inbox of the receiver. A process woken up by another
+ *    partition is posted to its own, and gets ready there in the next window.
+ *  - Balancing the partitions, moving the processes ready in the partitions
+ *    with more of them than their idle CPUs into the inboxes of the partitions
+ *    with idle CPUs.
+ *
+ * So a window is a tick once a process that may acquire resources or perform
+ * I/O is forked. Otherwise the partitions never interact until the next fork,
+ * and run up to @__lookahead ticks apart before they meet.
+ *
+ * Which thread simulates which partition makes no difference, so the result
+ * is the same for any number of threads.
+ */
+struct __exited {
+	struct process *p;
+	unsigned int at;		/* Tick at which @p exited */
+};
+
+static struct __partition {
+	unsigned int first;		/* CPUs from @first to @last - 1 */
+	unsigned int last;
+
+	struct list_head inbox;		/* Processes posted to the partition */
+	struct list_head outbox;	/* Processes posted by the partition */
+	struct list_head io;		/* Processes to start I/O after the tick */
+	unsigned int nr_inbox;
+	unsigned int nr_busy;		/* # of CPUs with a process at the barrier */
+
+	struct __exited *exited;	/* Processes exited in the window */
+	unsigned int nr_exited;
+	unsigned int size_exited;
+
+	struct __log_buffer *log;
+	bool *ran;				/* A CPU ran at each tick of the window */
+	struct process **next;	/* Processes picked for the CPUs */
+
+	unsigned long long nr_posted;	/* # of processes posted to the others */
+	unsigned long long nr_moved;	/* # of processes moved in by the balancing */
+} __attribute__((aligned(64))) *__partitions = NULL;
+
+/* Partition being simulated on this thread. NULL at the barriers */
+static __thread struct __partition *__active = NULL;
+
+/* CPUs with a process to run at the barrier, as it uses resources */
+static bool __deferred[MAX_CPUS];
+
+/* A process that may interact with the other partitions has been forked */
+static bool __synchronous = false;
+
+static unsigned long long __nr_windows = 0;
+
+/**
+ * The threads and the window they simulate
+ */
+#define PDES_SPINS	1024	/* Spins at the barrier before yielding */
+
+static struct {
+	const struct scheduler *s;
+	unsigned int from;		/* Window of ticks from @from to @to - 1 */
+	unsigned int to;
+	bool stop;
+
+	unsigned int nr;		/* # of threads including the main thread */
+	pthread_t *threads;
+	struct __stats **stats;	/* __stats and __inversion of each thread */
+	struct __inversion **inversion;
+
+	unsigned int arrived __attribute__((aligned(64)));
+	unsigned int phase __attribute__((aligned(64)));
+} __pool;
+
+static void __barrier(void)
+{
+	unsigned int phase = __atomic_load_n(&__pool.phase, __ATOMIC_ACQUIRE);
+
+	if (__atomic_add_fetch(&__pool.arrived, 1, __ATOMIC_ACQ_REL) == __pool.nr) {
+		__atomic_store_n(&__pool.arrived, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&__pool.phase, phase + 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	for (unsigned int spins = 0; __atomic_load_n(&__pool.phase, __ATOMIC_ACQUIRE) == phase; spins++) {
+		if (spins >= PDES_SPINS)
+			sched_yield();
+	}
+}
+
+/***********************************************************************
+ * Processes between the partitions
+ */
+
+/**
+ * Called by the ready queue for @p getting ready in another partition
+ */
+static void __post(struct process *p)
+{
+	struct __partition *to = __partitions + p->cold->__partition;
+
+	p->cold->__ready_at = ticks;
+
+	if (__active) {
+		list_add_tail(&p->list, &__active->outbox);
+		__active->nr_posted++;
+	} else {
+		list_add_tail(&p->list, &to->inbox);
+		to->nr_inbox++;
+	}
+}
+
+/**
+ * Deliver the processes in the outboxes to their partitions
+ */
+static void __deliver(void)
+{
+	struct process *p, *tmp;
+
+	for (unsigned int k = 0; k < __nr_partitions; k++) {
+		list_for_each_entry_safe(p, tmp, &__partitions[k].outbox, list) {
+			struct __partition *to = __partitions + p->cold->__partition;
+
+			list_move_tail(&p->list, &to->inbox);
+			to->nr_inbox++;
+		}
+	}
+}
+
+/**
+ * The processes in the inbox of @part get ready, keeping when they got ready
+ */
+static void __receive(struct __partition *part)
+{
+	struct process *p, *tmp;
+
+	list_for_each_entry_safe(p, tmp, &part->inbox, list) {
+		unsigned int ready_at = p->cold->__ready_at;
+
+		list_del_init(&p->list);
+		ready_enqueue(p);
+		p->cold->__ready_at = ready_at;
+	}
+	part->nr_inbox = 0;
+}
+
+static unsigned int __queued(unsigned int k)
+{
+	return __ready_count(k) + __partitions[k].nr_inbox;
+}
+
+static unsigned int __idle(unsigned int k)
+{
+	return __partitions[k].last - __partitions[k].first - __partitions[k].nr_busy;
+}
+
+/**
+ * Partition with the most CPUs left over after its processes
+ */
+static unsigned int __least_loaded(void)
+{
+	unsigned int best = 0;
+	long spare = (long)__idle(0) - __queued(0);
+
+	for (unsigned int k = 1; k < __nr_partitions; k++) {
+		long s = (long)__idle(k) - __queued(k);
+
+		if (s > spare) {
+			best = k;
+			spare = s;
+		}
+	}
+	return best;
+}
+
+/**
+ * Move the processes that would wait for a CPU in their partitions to the
+ * partitions that would leave CPUs idle. The donors are taken in order as
+ * the receivers are, so it is linear in the # of partitions
+ */
+static void __balance(void)
+{
+	unsigned int d = 0;
+
+	for (unsigned int r = 0; r < __nr_partitions; r++) {
+		struct __partition *to = __partitions + r;
+
+		while (__idle(r) > __queued(r)) {
+			struct process *p;
+
+			while (d < __nr_partitions &&
+			       (__queued(d) <= __idle(d) || !__ready_count(d))) {
+				d++;
+			}
+			if (d == __nr_partitions)
+				return;
+
+			p = __ready_steal(d);
+			p->cold->__partition = r;
+			list_add_tail(&p->list, &to->inbox);
+			to->nr_inbox++;
+			to->nr_moved++;
+		}
+	}
+}
+
+/***********************************************************************
+ * Simulation of a partition on a thread
+ */
+
+/**
+ * @p acquires or releases resources in the tick
+ */
+static bool __uses_resources(struct process *p)
+{
+	struct resource_schedule *rs;
+
+	if (!list_empty(&p->cold->__resources_holding))
+		return true;
+
+	list_for_each_entry(rs, &p->cold->__resources_to_acquire, list) {
+		if (rs->at == p->age)
+			return true;
+	}
+	return false;
+}
+
+static bool __io_due(struct process *p)
+{
+	struct io_schedule *io;
+
+	list_for_each_entry(io, &p->cold->__io_to_do, list) {
+		if (io->at == p->age && io->duration)
+			return true;
+	}
+	return false;
+}
+
+static void __exited(struct __partition *part, struct process *p)
+{
+	if (part->nr_exited == part->size_exited) {
+		part->size_exited = part->size_exited ? part->size_exited * 2 : 64;
+		part->exited = realloc(part->exited, sizeof(*part->exited) * part->size_exited);
+		assert(part->exited);
+	}
+	part->exited[part->nr_exited].p = p;
+	part->exited[part->nr_exited].at = ticks;
+	part->nr_exited++;
+}
+
+/**
+ * A tick of @part as __smp_simulate() does for all CPUs. Returns whether any
+ * CPU in the partition ran a process
+ */
+static bool __tick(const struct scheduler *s, struct __partition *part)
+{
+	unsigned int nr = part->last - part->first;
+	bool running = false;
+
+	for (unsigned int i = 0; i < nr; i++) {
+		struct __cpu *cpu = __cpus + part->first + i;
+		struct process *prev = cpu->curr;
+
+		if (cpu->pinned) {
+			part->next[i] = prev;
+			continue;
+		}
+
+		current = prev && prev->status != PROCESS_READY ? prev : NULL;
+		part->next[i] = s->schedule();
+
+		if (!prev)
+			continue;
+
+		if (prev->status == PROCESS_RUNNING) {
+			prev->status = PROCESS_READY;
+		} else {
+			cpu->curr = NULL;
+		}
+
+		/* Exited at the barrier, which the CPU does not wait for */
+		if (prev->age == prev->lifespan) {
+			prev->status = PROCESS_EXIT;
+			__exited(part, prev);
+			cpu->curr = NULL;
+		}
+	}
+
+	if (__affinity)
+		__smp_place(part->next, part->first, nr);
+
+	for (unsigned int i = 0; i < nr; i++) {
+		unsigned int c = part->first + i;
+		struct process *p = part->next[i];
+
+		if (!p) {
+			__cpus[c].curr = NULL;
+			__cpus[c].idle++;
+			continue;
+		}
+		running = true;
+
+		if (!__smp_enter(p, c))
+			continue;
+
+		if (__uses_resources(p)) {
+			__deferred[c] = true;
+			continue;
+		}
+
+		__log_event(EVENT_RUN, p->pid, c + 1);
+		p->age++;
+		__inversion_ran(p);
+
+		if (p->age < p->lifespan && __io_due(p))
+			list_add_tail(&p->list, &part->io);
+	}
+	current = NULL;
+
+	return running;
+}
+
+static void __simulate_partition(const struct scheduler *s, unsigned int k)
+{
+	struct __partition *part = __partitions + k;
+
+	__ready_enter(k);
+	__active = part;
+	__log_redirect(part->log);
+
+	ticks = __pool.from;
+	__receive(part);
+
+	for (; ticks < __pool.to; ticks++) {
+		part->ran[ticks - __pool.from] = __tick(s, part);
+	}
+
+	__log_redirect(NULL);
+	__active = NULL;
+	__ready_leave();
+}
+
+/**
+ * Simulate the partitions of thread @id in the window
+ */
+static void __simulate_window(unsigned int id)
+{
+	for (unsigned int k = id; k < __nr_partitions; k += __pool.nr) {
+		__simulate_partition(__pool.s, k);
+	}
+}
+
+static void *__worker(void *data)
+{
+	unsigned int id = (unsigned long)data;
+
+	INIT_LIST_HEAD(&readyqueue);
+	__pool.stats[id] = &__stats;
+	__pool.inversion[id] = &__inversion;
+
+	while (true) {
+		__barrier();
+		if (__pool.stop)
+			break;
+		__simulate_window(id);
+		__barrier();
+	}
+	return NULL;
+}
+
+/***********************************************************************
+ * The barrier on the main thread
+ */
+static void __fork(const struct scheduler *s)
+{
+	struct process *p, *tmp;
+
+	__fill_from_stream();
+
+	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
+		if (p->cold->__starts_at > ticks)
+			break;
+
+		list_del_init(&p->list);
+		p->status = PROCESS_READY;
+		__log_event(EVENT_FORK, p->pid, 0);
+
+		if (!list_empty(&p->cold->__resources_to_acquire) ||
+		    !list_empty(&p->cold->__io_to_do)) {
+			__synchronous = true;
+		}
+
+		/* Posted to the partition, as no partition is active here */
+		p->cold->__partition = __least_loaded();
+		if (!__start_io(p, ticks))
+			ready_enqueue(p);
+
+		if (s->forked)
+			s->forked(p);
+	}
+}
+
+/**
+ * Ticks the partitions can run apart from now
+ */
+static unsigned int __window(void)
+{
+	unsigned int window = __lookahead;
+
+	if (__synchronous)
+		return 1;
+
+	/* @__forkqueue keeps the next process to fork */
+	if (!list_empty(&__forkqueue)) {
+		struct process *p = list_first_entry(&__forkqueue, struct process, list);
+
+		if (p->cold->__starts_at - ticks < window)
+			window = p->cold->__starts_at - ticks;
+	}
+	return window;
+}
+
+/**
+ * Run the CPUs deferred as their processes use resources in the tick
+ */
+static void __run_deferred(const struct scheduler *s)
+{
+	for (unsigned int k = 0; k < __nr_partitions; k++) {
+		struct __partition *part = __partitions + k;
+		bool entered = false;
+
+		for (unsigned int c = part->first; c < part->last; c++) {
+			if (!__deferred[c])
+				continue;
+			__deferred[c] = false;
+
+			if (!entered) {
+				__ready_enter(k);
+				__active = part;
+				entered = true;
+			}
+			current = __cpus[c].curr;
+			__smp_run(s, c);
+		}
+		current = NULL;
+
+		if (entered) {
+			__active = NULL;
+			__ready_leave();
+		}
+	}
+}
+
+static void __start_io_all(void)
+{
+	struct process *p, *tmp;
+
+	for (unsigned int k = 0; k < __nr_partitions; k++) {
+		list_for_each_entry_safe(p, tmp, &__partitions[k].io, list) {
+			list_del_init(&p->list);
+			__start_io(p, ticks + 1);
+		}
+	}
+}
+
+/**
+ * Fold the ticks run on the threads for the priority inversion. A waiter
+ * only acquires a resource at the barriers, so it sees them all
+ */
+static void __fold_inversion(void)
+{
+	for (unsigned int i = 1; i < __pool.nr; i++) {
+		struct __inversion *inv = __pool.inversion[i];
+
+		for (unsigned int j = 0; j < 2; j++) {
+			for (unsigned int prio = 0; prio <= MAX_PRIO; prio++) {
+				__inversion.ran[j][prio] += inv->ran[j][prio];
+				inv->ran[j][prio] = 0;
+			}
+		}
+	}
+}
+
+static bool __pending(void)
+{
+	if (!list_empty(&__forkqueue) || __timer_pending())
+		return true;
+
+	for (unsigned int k = 0; k < __nr_partitions; k++) {
+		if (__queued(k) || !list_empty(&__partitions[k].outbox))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Go over the ticks of the window in order, as if the partitions were
+ * simulated together. Returns false when the simulation is over at @ticks
+ */
+static bool __close_window(const struct scheduler *s)
+{
+	unsigned int from = __pool.from;
+	bool single = __pool.to - from == 1;
+
+	__fold_inversion();
+
+	for (ticks = from; ticks < __pool.to; ticks++) {
+		bool running = false;
+
+		for (unsigned int k = 0; k < __nr_partitions; k++) {
+			__log_replay(__partitions[k].log, ticks + 1);
+			running |= __partitions[k].ran[ticks - from];
+		}
+
+		if (single) {
+			__run_deferred(s);
+			__start_io_all();
+		}
+
+		for (unsigned int k = 0; k < __nr_partitions; k++) {
+			struct __partition *part = __partitions + k;
+			unsigned int i = 0;
+
+			for (; i < part->nr_exited && part->exited[i].at == ticks; i++) {
+				__exit_process(s, part->exited[i].p);
+			}
+			if (!i)
+				continue;
+			part->nr_exited -= i;
+			memmove(part->exited, part->exited + i, sizeof(*part->exited) * part->nr_exited);
+		}
+
+		if (!running) {
+			if (!__pending())
+				return false;
+
+			__log_event(EVENT_IDLE, 0, 0);
+			__stats.nr_idle++;
+		}
+	}
+
+	__deliver();
+	return true;
+}
+
+/***********************************************************************
+ * Setting up the partitions and the threads
+ */
+static void __setup(const struct scheduler *s)
+{
+	unsigned int lookahead = __lookahead > 1 ? __lookahead : 1;
+
+	/* Aligned so that the partitions do not share cache lines */
+	if (posix_memalign((void **)&__partitions, 64, sizeof(*__partitions) * __nr_partitions))
+		__partitions = NULL;
+	assert(__partitions);
+	memset(__partitions, 0, sizeof(*__partitions) * __nr_partitions);
+
+	for (unsigned int k = 0; k < __nr_partitions; k++) {
+		struct __partition *part = __partitions + k;
+
+		part->first = __nr_cpus * k / __nr_partitions;
+		part->last = __nr_cpus * (k + 1) / __nr_partitions;
+		INIT_LIST_HEAD(&part->inbox);
+		INIT_LIST_HEAD(&part->outbox);
+		INIT_LIST_HEAD(&part->io);
+		part->log = __log_buffer_alloc();
+		part->ran = calloc(lookahead, sizeof(*part->ran));
+		part->next = calloc(part->last - part->first, sizeof(*part->next));
+		assert(part->ran && part->next);
+	}
+	__ready_partition(__nr_partitions, __post);
+
+	__pool.s = s;
+	__pool.nr = __nr_threads;
+	if (!__pool.nr) {
+		long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		__pool.nr = nr_cpus > 0 ? nr_cpus : 1;
+	}
+	if (__pool.nr > __nr_partitions)
+		__pool.nr = __nr_partitions;
+
+	__pool.threads = calloc(__pool.nr, sizeof(*__pool.threads));
+	__pool.stats = calloc(__pool.nr, sizeof(*__pool.stats));
+	__pool.inversion = calloc(__pool.nr, sizeof(*__pool.inversion));
+	assert(__pool.threads && __pool.stats && __pool.inversion);
+
+	__pool.stats[0] = &__stats;
+	__pool.inversion[0] = &__inversion;
+	for (unsigned int i = 1; i < __pool.nr; i++) {
+		if (pthread_create(__pool.threads + i, NULL, __worker, (void *)(unsigned long)i)) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/**
+ * Sum up the statistics of the threads, and stop them
+ */
+static void __teardown(void)
+{
+	__fold_inversion();
+
+	for (unsigned int i = 1; i < __pool.nr; i++) {
+		struct __stats *st = __pool.stats[i];
+
+		__stats.response += st->response;
+		__stats.nr_dispatches += st->nr_dispatches;
+		__stats.nr_starved += st->nr_starved;
+		if (__stats.max_ready_wait < st->max_ready_wait)
+			__stats.max_ready_wait = st->max_ready_wait;
+		__stats.nr_wakeups += st->nr_wakeups;
+		__stats.wake_latency += st->wake_latency;
+		if (__stats.max_wake_latency < st->max_wake_latency)
+			__stats.max_wake_latency = st->max_wake_latency;
+	}
+
+	__pool.stop = true;
+	__barrier();
+	for (unsigned int i = 1; i < __pool.nr; i++) {
+		pthread_join(__pool.threads[i], NULL);
+	}
+}
+
+/***********************************************************************
+ * The main loop for the simulation of the partitions
+ */
+void __pdes_simulate(const struct scheduler *s)
+{
+	assert(s->schedule && "scheduler.schedule() not implemented");
+
+	__setup(s);
+
+	while (true) {
+		/* Wake up the processes completing I/O */
+		__timer_expire(ticks, __complete_io);
+
+		for (unsigned int k = 0; k < __nr_partitions; k++) {
+			struct __partition *part = __partitions + k;
+
+			part->nr_busy = 0;
+			for (unsigned int c = part->first; c < part->last; c++) {
+				part->nr_busy += !!__cpus[c].curr;
+			}
+		}
+
+		__fork(s);
+		__balance();
+
+		__pool.from = ticks;
+		__pool.to = ticks + __window();
+		__nr_windows++;
+
+		__barrier();
+		__simulate_window(0);
+		__barrier();
+
+		if (!__close_window(s))
+			break;
+	}
+
+	__stats.ticks = ticks;
+
+	__teardown();
+}
+
+/**
+ * CPUs of partition @k, from @first to @last - 1
+ */
+void __pdes_cpus(unsigned int k, unsigned int *first, unsigned int *last)
+{
+	*first = __partitions[k].first;
+	*last = __partitions[k].last;
+}
+
+void __pdes_report(void)
+{
+	unsigned long long nr_posted = 0, nr_moved = 0;
+
+	for (unsigned int k = 0; k < __nr_partitions; k++) {
+		nr_posted += __partitions[k].nr_posted;
+		nr_moved += __partitions[k].nr_moved;
+	}
+
+	printf("%u partitions on %u thread%s, %llu windows of up to %u ticks\n",
+	       __nr_partitions, __pool.nr, __pool.nr > 1 ? "s" : "", __nr_windows, __lookahead);
+	printf("Woken up from the other partitions: %llu, moved by the balancing: %llu\n",
+	       nr_posted, nr_moved);
+}
@@ -0,0 +1,66 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+
+#include "simulator.h"
+
+/***********************************************************************
+ * Load a scheduling policy from the shared object at @path
+ *
+ * DESCRIPTION
+ *   The shared object should define its scheduler with SCHED_PLUGIN() in
+ *   sched.h, and be built for the same SCHED_PLUGIN_VERSION. The framework
+ *   exports its symbols (current, readyqueue, ready_enqueue(), ...) so that
+ *   the plugin uses them just as the built-in policies do. The object is
+ *   never unloaded.
+ *
+ * RETURN
+ *   The scheduler, or NULL on error
+ */
+struct scheduler *__load_policy(const char *path)
+{
+	const unsigned int *version;
+	struct scheduler **scheduler;
+	void *handle;
+
+	if (!(handle = dlopen(path, RTLD_NOW | RTLD_LOCAL))) {
+		fprintf(stderr, "%s\n", dlerror());
+		return NULL;
+	}
+
+	version = dlsym(handle, "sched_plugin_version");
+	scheduler = dlsym(handle, "sched_plugin");
+	if (!version || !scheduler || !*scheduler) {
+		fprintf(stderr, "%s: Not a scheduler plugin\n", path);
+		goto out_close;
+	}
+	if (*version != SCHED_PLUGIN_VERSION) {
+		fprintf(stderr, "%s: Built for plugin version %u, but %u is required\n",
+			path, *version, SCHED_PLUGIN_VERSION);
+		goto out_close;
+	}
+	if (!(*scheduler)->schedule) {
+		fprintf(stderr, "%s: No schedule() in %s\n", path, (*scheduler)->name);
+		goto out_close;
+	}
+	return *scheduler;
+
+out_close:
+	dlclose(handle);
+	return NULL;
+}
@@ -0,0 +1,74 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * The schedulers in pa2.c along with the simulation loop specialised for each
+ * of them. pa2.c is included instead of being linked on its own so that the
+ * policies are visible to the compiler when it instantiates the loop.
+ */
+#include "pa2.c"
+
+#include "simulator.h"
+
+#define __LOOP_SPECIALIZED
+#include "loop.h"
+
+/**
+ * Instantiate the loop for @policy calling back the hooks given as the
+ * initializer of a constant struct scheduler. The hooks should be the same as
+ * the ones of @policy_scheduler. Otherwise the specialised loop is not used
+ */
+#define SPECIALIZE(policy, ...) \
+	static const struct scheduler __##policy##_hooks = { __VA_ARGS__ }; \
+	static void __simulate_##policy(void) \
+	{ \
+		__simulate(&__##policy##_hooks); \
+	}
+
+SPECIALIZE(fcfs, .acquire = fcfs_acquire, .release = fcfs_release, .schedule = fcfs_schedule)
+SPECIALIZE(sjf, .acquire = fcfs_acquire, .release = fcfs_release, .schedule = sjf_schedule)
+SPECIALIZE(stcf, .acquire = fcfs_acquire, .release = fcfs_release, .schedule = stcf_schedule)
+SPECIALIZE(rr, .acquire = fcfs_acquire, .release = fcfs_release, .schedule = rr_schedule)
+SPECIALIZE(prio, .acquire = prio_acquire, .release = prio_release, .schedule = prio_schedule, .woken = prio_woken)
+SPECIALIZE(pa, .acquire = prio_acquire, .release = prio_release, .schedule = pa_schedule, .woken = prio_woken)
+SPECIALIZE(pcp, .acquire = pcp_acquire, .release = pcp_release, .schedule = pcp_schedule, .woken = prio_woken)
+SPECIALIZE(pip, .acquire = pip_acquire, .release = pip_release, .schedule = pip_schedule, .woken = prio_woken)
+
+static const struct {
+	const struct scheduler *hooks;
+	void (*simulate)(void);
+} __specialized[] = {
+	{ &__fcfs_hooks, __simulate_fcfs },
+	{ &__sjf_hooks, __simulate_sjf },
+	{ &__stcf_hooks, __simulate_stcf },
+	{ &__rr_hooks, __simulate_rr },
+	{ &__prio_hooks, __simulate_prio },
+	{ &__pa_hooks, __simulate_pa },
+	{ &__pcp_hooks, __simulate_pcp },
+	{ &__pip_hooks, __simulate_pip },
+};
+
+void (*__specialized_simulation(const struct scheduler *s))(void)
+{
+	for (unsigned int i = 0; i < sizeof(__specialized) / sizeof(*__specialized); i++) {
+		const struct scheduler *h = __specialized[i].hooks;
+
+		if (s->schedule == h->schedule && s->acquire == h->acquire &&
+		    s->release == h->release && s->forked == h->forked &&
+		    s->exiting == h->exiting && s->woken == h->woken)
+			return __specialized[i].simulate;
+	}
+	return NULL;
+}
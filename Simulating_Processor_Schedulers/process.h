@@ -16,7 +16,9 @@
 #ifndef __PROCESS_H__
 #define __PROCESS_H__
 
-struct list_head;
+#include "resource.h"
+
+#define MAX_PRIO	64	/* Maximum value for priority */
 
 enum process_status {
 	PROCESS_READY,		/* Process is ready to run */
@@ -25,6 +27,84 @@ enum process_status {
 	PROCESS_EXIT,		/* The process is exited */
 };
 
+/**
+ * Bookkeeping of a process that is rarely accessed while making scheduling
+ * decisions. It is kept apart from struct process so that the fields used at
+ * every tick are packed densely in the process table.
+ */
+struct process_cold {
+	struct resource *waiting_for;
+							/* The resource that the process is blocked on */
+	bool wants_shared;		/* Whether the process is acquiring the resource,
+							   or waiting for it, in the shared mode */
+
+	unsigned long long prio_donated_map[(MAX_PRIO + 64) / 64];
+	unsigned char prio_donated[MAX_PRIO + 1];
+							/* Priorities donated to the process through the
+							   resources it is holding, counted per level.
+							   Bit n of the map is set iff prio_donated[n] != 0
+							   so that the highest one is found by a bit scan */
+
+	unsigned int nr_ceilings;
+	struct {
+		unsigned char resource_id;
+		unsigned char prio;
+	} ceilings[NR_RESOURCES];
+							/* Stack of the ceilings of the resources that the
+							   process is holding (PCP). @prio is the effective
+							   priority while the entry is on the top */
+
+
+	/** DO NOT ACCESS FOLLOWING VARIABLES. THESE ARE USED FOR SIMULATOR IMPLEMENTATION **/
+	unsigned int __starts_at;	/* When to fork the process */
+
+	struct list_head __resources_to_acquire;
+								/* Schedule to acquire resources */
+
+	struct list_head __resources_holding;
+								/* Resources that the process is currently holding */
+
+	unsigned int __nr_dispatches;
+								/* # of times the process was scheduled in */
+
+	unsigned int __blocked_at;	/* Tick + 1 when the process got blocked on the
+								   resource it is acquiring. 0 if not blocked */
+	unsigned long long __inversion_mark[2];
+								/* Ticks run below the priority when blocked */
+	unsigned int __inversion[2];
+								/* Ticks of direct and unbounded inversion */
+	unsigned int __ready_at;	/* When the process was put into the ready queue */
+	unsigned int __nr_starved;	/* # of times it waited too long in there */
+	unsigned long long __woken_at;
+								/* Tick, or ns with --tick-ns, + 1 when the
+								   process got woken up. 0 once it runs */
+
+	struct list_head __io_to_do;
+								/* Schedule to perform I/O */
+	unsigned int __io_until;	/* When the ongoing I/O completes */
+	unsigned long long __io_seq;
+								/* Order of starting the ongoing I/O */
+	unsigned int __io_ticks;	/* # of ticks spent for I/O */
+
+	unsigned int __slot;		/* Slot in the process table */
+
+	unsigned int __ready_index;	/* Index in the ready set + 1. 0 if not ready */
+	unsigned int __group;		/* Group the process belongs to */
+
+	unsigned int __working_set;	/* KB of memory the process touches as it runs */
+	unsigned int __cpu;			/* CPU the process ran on last + 1. 0 if never */
+	unsigned long long __cpu_mark;
+								/* KB loaded into the cache of the CPU when the
+								   process ran there last */
+	unsigned int __cpu_missing;	/* KB of the working set not loaded by then */
+	unsigned int __partition;	/* Partition of the CPUs the process is in */
+
+	unsigned long long __ns_starts_at;
+	unsigned long long __ns_lifespan;
+	unsigned long long __ns_age;
+	unsigned long long __ns_io;	/* The times above in ns with --tick-ns */
+};
+
 struct process {
 	unsigned int pid;		/* Process ID */
 
@@ -39,21 +119,14 @@ struct process {
 							   0 by default, and the larger, the more important
 							   process it is */
 
-	struct list_head list;	/* list head for listing processes */
-
 	unsigned int prio_orig;	/* The original priority of the process. You might
 							   need it to implement dynamic priority features
 							   such as aging, PIP and PCP. */
 
+	struct list_head list;	/* list head for listing processes */
 
-	/** DO NOT ACCESS FOLLOWING VARIABLES. THESE ARE USED FOR SIMULATOR IMPLEMENTATION **/
-	unsigned int __starts_at;	/* When to fork the process */
-
-	struct list_head __resources_to_acquire;
-								/* Schedule to acquire resources */
-
-	struct list_head __resources_holding;
-								/* Resources that the process is currently holding */
+	struct process_cold *cold;
+							/* Rarely accessed part of the process */
 };
 
 /**
@@ -61,6 +134,4 @@ struct process {
  */
 void dump_status(void);
 
-#define MAX_PRIO	64	/* Maximum value for priority */
-
 #endif
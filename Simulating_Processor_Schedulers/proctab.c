@@ -0,0 +1,111 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "simulator.h"
+
+/**
+ * The process table.
+ *
+ * Processes are allocated in slots of chunks rather than one by one from the
+ * heap. The hot part (struct process) and the cold part (struct process_cold)
+ * of a slot live in parallel chunks, so the fields the schedulers read at
+ * every tick are packed contiguously. Chunks are never moved as processes are
+ * linked through the list heads embedded in them. Freed slots are reused in
+ * the LIFO order to keep the table as dense as the number of live processes.
+ */
+#define PROCTAB_CHUNK_SHIFT	10
+#define PROCTAB_CHUNK_SIZE	(1U << PROCTAB_CHUNK_SHIFT)
+
+static struct {
+	struct process **hot;
+	struct process_cold **cold;
+	unsigned int nr_chunks;
+
+	unsigned int nr_slots;	/* # of slots ever handed out */
+
+	unsigned int *free;		/* Stack of the freed slots */
+	unsigned int nr_free;
+} __proctab;
+
+static void __proctab_grow(void)
+{
+	unsigned int nr = __proctab.nr_chunks + 1;
+
+	__proctab.hot = realloc(__proctab.hot, sizeof(*__proctab.hot) * nr);
+	__proctab.cold = realloc(__proctab.cold, sizeof(*__proctab.cold) * nr);
+	__proctab.free = realloc(__proctab.free, sizeof(*__proctab.free) * nr * PROCTAB_CHUNK_SIZE);
+	assert(__proctab.hot && __proctab.cold && __proctab.free);
+
+	__proctab.hot[nr - 1] = malloc(sizeof(struct process) * PROCTAB_CHUNK_SIZE);
+	__proctab.cold[nr - 1] = malloc(sizeof(struct process_cold) * PROCTAB_CHUNK_SIZE);
+	assert(__proctab.hot[nr - 1] && __proctab.cold[nr - 1]);
+
+	__proctab.nr_chunks = nr;
+}
+
+/**
+ * Reserve @nr consecutive slots, which are initialized later with
+ * __init_process(). Used to allocate processes on multiple threads
+ */
+unsigned int __reserve_processes(unsigned int nr)
+{
+	unsigned int slot = __proctab.nr_slots;
+
+	while (__proctab.nr_slots + nr > __proctab.nr_chunks * PROCTAB_CHUNK_SIZE) {
+		__proctab_grow();
+	}
+	__proctab.nr_slots += nr;
+
+	return slot;
+}
+
+struct process *__init_process(unsigned int slot)
+{
+	struct process *p;
+	struct process_cold *cold;
+
+	p = __proctab.hot[slot >> PROCTAB_CHUNK_SHIFT] + (slot & (PROCTAB_CHUNK_SIZE - 1));
+	cold = __proctab.cold[slot >> PROCTAB_CHUNK_SHIFT] + (slot & (PROCTAB_CHUNK_SIZE - 1));
+
+	memset(p, 0x00, sizeof(*p));
+	memset(cold, 0x00, sizeof(*cold));
+
+	p->cold = cold;
+	cold->__slot = slot;
+
+	INIT_LIST_HEAD(&p->list);
+	INIT_LIST_HEAD(&cold->__resources_to_acquire);
+	INIT_LIST_HEAD(&cold->__resources_holding);
+	INIT_LIST_HEAD(&cold->__io_to_do);
+
+	return p;
+}
+
+struct process *__alloc_process(void)
+{
+	if (__proctab.nr_free)
+		return __init_process(__proctab.free[--__proctab.nr_free]);
+
+	return __init_process(__reserve_processes(1));
+}
+
+void __free_process(struct process *p)
+{
+	__proctab.free[__proctab.nr_free++] = p->cold->__slot;
+}
@@ -0,0 +1,336 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/* For clock_gettime() */
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "simulator.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define __HAVE_RDTSC
+#endif
+
+bool __profiling = false;
+const char *__profile_stacks = NULL;
+
+/**
+ * Profile of the simulation with -P.
+ *
+ * The phases of the simulation loop and the callbacks to the scheduler are
+ * timed with the time stamp counter, or with the monotonic clock in ns where
+ * there is none. The phases nest, so they are timed on a stack; each phase
+ * accounts its time as a whole and, excluding the phases nested in it, as its
+ * own. The own time is also accumulated per stack of the phases, which is
+ * written out in the collapsed format of the flame graph tools.
+ *
+ * The callbacks are timed by running the scheduler wrapped in
+ * __profile_sched(), which is never the one the simulation loop is
+ * specialised for. So the specialised loops are compiled without the hooks.
+ */
+#define PROFILE_BUCKETS		64
+#define PROFILE_MAX_DEPTH	8
+#define PROFILE_MAX_STACKS	256	/* Power of 2 */
+
+static const char *__phase_names[NR_PROFILE_PHASES] = {
+	[PROFILE_SIMULATE] = "simulate",
+	[PROFILE_IO] = "complete_io",
+	[PROFILE_FORK] = "fork_on_schedule",
+	[PROFILE_ACQUIRE] = "run_current_acquire",
+	[PROFILE_RELEASE] = "run_current_release",
+	[PROFILE_EXIT] = "exit_process",
+	[PROFILE_SCHEDULE] = "schedule()",
+	[PROFILE_FORKED] = "forked()",
+	[PROFILE_EXITING] = "exiting()",
+	[PROFILE_ACQUIRE_CB] = "acquire()",
+	[PROFILE_RELEASE_CB] = "release()",
+	[PROFILE_WOKEN] = "woken()",
+};
+
+struct __phase {
+	unsigned long long calls;
+	unsigned long long total;
+	unsigned long long self;
+	unsigned long long max;
+	unsigned long long hist[PROFILE_BUCKETS];
+};
+
+static struct __phase __phases[NR_PROFILE_PHASES];
+
+static struct {
+	unsigned int phase;
+	unsigned long long stack;	/* Phases up to this one, in base NR_PROFILE_PHASES + 1 */
+	unsigned long long start;
+	unsigned long long nested;	/* Time in the phases nested in this one */
+} __frames[PROFILE_MAX_DEPTH];
+static unsigned int __depth = 0;
+
+static struct {
+	unsigned long long stack;	/* 0 if the entry is empty */
+	unsigned long long self;
+} __stacks[PROFILE_MAX_STACKS];
+
+static unsigned long long __now(void)
+{
+#ifdef __HAVE_RDTSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static unsigned long long __ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int __bucket(unsigned long long v)
+{
+	return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+void __profile_enter(enum profile_phase phase)
+{
+	unsigned long long stack = __depth ? __frames[__depth - 1].stack : 0;
+
+	assert(__depth < PROFILE_MAX_DEPTH);
+
+	__frames[__depth].phase = phase;
+	__frames[__depth].stack = stack * (NR_PROFILE_PHASES + 1) + phase + 1;
+	__frames[__depth].nested = 0;
+	__frames[__depth].start = __now();
+	__depth++;
+}
+
+static void __add_stack(unsigned long long stack, unsigned long long self)
+{
+	unsigned int i = (stack * 0x9e3779b97f4a7c15ULL) >> 56;
+
+	while (__stacks[i].stack && __stacks[i].stack != stack) {
+		i = (i + 1) & (PROFILE_MAX_STACKS - 1);
+	}
+	__stacks[i].stack = stack;
+	__stacks[i].self += self;
+}
+
+void __profile_leave(enum profile_phase phase)
+{
+	unsigned long long elapsed = __now();
+	struct __phase *ph = __phases + phase;
+	unsigned int d = --__depth;
+
+	assert(__frames[d].phase == phase);
+
+	elapsed -= __frames[d].start;
+	if (d)
+		__frames[d - 1].nested += elapsed;
+
+	ph->calls++;
+	ph->total += elapsed;
+	ph->self += elapsed - __frames[d].nested;
+	if (ph->max < elapsed)
+		ph->max = elapsed;
+	ph->hist[__bucket(elapsed)]++;
+
+	__add_stack(__frames[d].stack, elapsed - __frames[d].nested);
+}
+
+/***********************************************************************
+ * The scheduler with the callbacks timed
+ */
+static struct scheduler *__inner;
+
+static void __profile_forked(struct process *p)
+{
+	__profile_enter(PROFILE_FORKED);
+	__inner->forked(p);
+	__profile_leave(PROFILE_FORKED);
+}
+
+static void __profile_exiting(struct process *p)
+{
+	__profile_enter(PROFILE_EXITING);
+	__inner->exiting(p);
+	__profile_leave(PROFILE_EXITING);
+}
+
+static struct process *__profile_schedule(void)
+{
+	struct process *next;
+
+	__profile_enter(PROFILE_SCHEDULE);
+	next = __inner->schedule();
+	__profile_leave(PROFILE_SCHEDULE);
+	return next;
+}
+
+static bool __profile_acquire(int resource_id)
+{
+	bool acquired;
+
+	__profile_enter(PROFILE_ACQUIRE_CB);
+	acquired = __inner->acquire(resource_id);
+	__profile_leave(PROFILE_ACQUIRE_CB);
+	return acquired;
+}
+
+static void __profile_release(int resource_id)
+{
+	__profile_enter(PROFILE_RELEASE_CB);
+	__inner->release(resource_id);
+	__profile_leave(PROFILE_RELEASE_CB);
+}
+
+static bool __profile_woken(struct process *p)
+{
+	bool preempt;
+
+	__profile_enter(PROFILE_WOKEN);
+	preempt = __inner->woken(p);
+	__profile_leave(PROFILE_WOKEN);
+	return preempt;
+}
+
+static struct scheduler __profile_scheduler;
+
+/**
+ * @inner with its callbacks timed. The ones left NULL stay NULL
+ */
+struct scheduler *__profile_sched(struct scheduler *inner)
+{
+	__inner = inner;
+
+	__profile_scheduler = (struct scheduler) {
+		.name = inner->name,
+		.initialize = inner->initialize,
+		.finalize = inner->finalize,
+		.forked = inner->forked ? __profile_forked : NULL,
+		.exiting = inner->exiting ? __profile_exiting : NULL,
+		.schedule = inner->schedule ? __profile_schedule : NULL,
+		.acquire = inner->acquire ? __profile_acquire : NULL,
+		.release = inner->release ? __profile_release : NULL,
+		.woken = inner->woken ? __profile_woken : NULL,
+	};
+	return &__profile_scheduler;
+}
+
+/***********************************************************************
+ * Report the time spent in each phase
+ */
+static unsigned long long __started_ns;
+static unsigned long long __elapsed_ns;
+
+void __profile_start(void)
+{
+	__started_ns = __ns();
+	__profile_enter(PROFILE_SIMULATE);
+}
+
+void __profile_stop(void)
+{
+	__profile_leave(PROFILE_SIMULATE);
+	__elapsed_ns = __ns() - __started_ns;
+}
+
+/**
+ * Upper bound of the bucket of @ph where the @pct percent of the calls fall,
+ * but no more than the longest call
+ */
+static unsigned long long __percentile(const struct __phase *ph, unsigned int pct)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned int i = 0; i < PROFILE_BUCKETS; i++) {
+		sum += ph->hist[i];
+		if (sum * 100 >= ph->calls * pct) {
+			unsigned long long bound = i ? (1ULL << i) - 1 : 0;
+			return bound < ph->max ? bound : ph->max;
+		}
+	}
+	return ph->max;
+}
+
+static void __write_stacks(const char *filename)
+{
+	FILE *file = fopen(filename, "w");
+
+	if (!file) {
+		perror(filename);
+		return;
+	}
+
+	for (unsigned int i = 0; i < PROFILE_MAX_STACKS; i++) {
+		unsigned int phases[PROFILE_MAX_DEPTH];
+		unsigned long long stack = __stacks[i].stack;
+		unsigned int nr = 0;
+
+		if (!stack || !__stacks[i].self)
+			continue;
+
+		for (; stack; stack /= NR_PROFILE_PHASES + 1) {
+			phases[nr++] = stack % (NR_PROFILE_PHASES + 1) - 1;
+		}
+		while (nr--) {
+			fprintf(file, "%s%s", __phase_names[phases[nr]], nr ? ";" : "");
+		}
+		fprintf(file, " %llu\n", __stacks[i].self);
+	}
+	fclose(file);
+}
+
+void __profile_report(void)
+{
+	unsigned long long total = __phases[PROFILE_SIMULATE].total;
+
+#ifdef __HAVE_RDTSC
+	printf("\nProfile in cycles of the time stamp counter, %.2f per ns\n",
+	       __elapsed_ns ? (double)total / __elapsed_ns : 0.0);
+#else
+	printf("\nProfile in ns\n");
+#endif
+	printf("%-22s %10s %14s %14s %6s %8s %8s %8s %10s\n", "Phase", "Calls", "Total", "Self",
+	       "Self%", "Mean", "p50", "p99", "Max");
+
+	for (unsigned int i = 0; i < NR_PROFILE_PHASES; i++) {
+		struct __phase *ph = __phases + i;
+
+		if (!ph->calls)
+			continue;
+		printf("%-22s %10llu %14llu %14llu %5.1f%% %8llu %8llu %8llu %10llu\n",
+		       __phase_names[i], ph->calls, ph->total, ph->self,
+		       total ? ph->self * 100.0 / total : 0.0, ph->total / ph->calls,
+		       __percentile(ph, 50), __percentile(ph, 99),
+		       ph->max);
+	}
+
+	if (__profile_stacks) {
+		__write_stacks(__profile_stacks);
+		printf("Wrote the collapsed stacks to %s\n", __profile_stacks);
+	}
+}
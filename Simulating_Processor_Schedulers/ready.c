@@ -0,0 +1,561 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "simulator.h"
+#include "ready.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define __HAVE_X86_SIMD
+#endif
+
+extern __thread struct list_head readyqueue;
+extern __thread unsigned int ticks;
+
+/**
+ * The ready set. Keys of the ready processes are packed in arrays indexed in
+ * parallel, so a pick-next is a linear scan over a few contiguous arrays
+ * instead of chasing the list. Entries are not ordered; @seq tells the order
+ * in @list as processes are always appended to its tail.
+ *
+ * There is a ready set for each group when the groups are scheduled by their
+ * shares, one for each partition of the CPUs when they are simulated in
+ * parallel, and one for all processes otherwise. @__ready is the one being
+ * scheduled on this thread, whose processes are in @readyqueue of the thread.
+ * The others keep theirs in their own @head.
+ */
+struct __ready_set {
+	unsigned int *prio;
+	unsigned int *remaining;
+	unsigned int *lifespan;
+	unsigned int *seq;
+	struct process **proc;
+	unsigned int nr;
+	unsigned int size;
+	unsigned int next_seq;
+
+	struct list_head head;
+};
+
+static struct __ready_set __ready_sets[MAX_GROUPS];
+static __thread struct __ready_set *__ready = __ready_sets;
+static bool __grouped = false;
+static unsigned int __nr_ready = 0;
+static unsigned long long __work_ready = 0;	/* Ticks left in the ready processes */
+
+/**
+ * Ready sets of the partitions, and where to post the processes getting ready
+ * in the partitions other than the one being simulated on this thread
+ */
+static struct __ready_set *__partition_sets = NULL;
+static void (*__ready_post)(struct process *p) = NULL;
+
+static inline struct __ready_set *__set_of(struct process *p)
+{
+	if (__partition_sets)
+		return __partition_sets + p->cold->__partition;
+	return __grouped ? __ready_sets + p->cold->__group : __ready_sets;
+}
+
+static inline struct list_head *__list_of(struct __ready_set *s)
+{
+	return s == __ready ? &readyqueue : &s->head;
+}
+
+/***********************************************************************
+ * Argmax kernels
+ *
+ * Find the index of the entry with the largest @key ^ @flip, taking the one
+ * with the smallest @seq among them. @flip is 0 to find the largest key and
+ * ~0 to find the smallest one. @nr should be larger than 0.
+ */
+unsigned int __ready_argbest_scalar(const unsigned int *key, const unsigned int *seq,
+				    unsigned int nr, unsigned int flip)
+{
+	unsigned int best = 0;
+	unsigned int bk = key[0] ^ flip;
+	unsigned int bs = seq[0];
+
+	for (unsigned int i = 1; i < nr; i++) {
+		unsigned int k = key[i] ^ flip;
+
+		if (k > bk || (k == bk && seq[i] < bs)) {
+			best = i;
+			bk = k;
+			bs = seq[i];
+		}
+	}
+	return best;
+}
+
+/**
+ * Reduce the per-lane bests of the vector kernels and scan the leftovers
+ */
+static unsigned int __argbest_reduce(const unsigned int *lk, const unsigned int *ls,
+				     const unsigned int *li, unsigned int nr_lanes,
+				     const unsigned int *key, const unsigned int *seq,
+				     unsigned int from, unsigned int nr, unsigned int flip)
+{
+	unsigned int best = li[0];
+	unsigned int bk = lk[0];
+	unsigned int bs = ls[0];
+
+	for (unsigned int i = 1; i < nr_lanes; i++) {
+		if (lk[i] > bk || (lk[i] == bk && ls[i] < bs)) {
+			best = li[i];
+			bk = lk[i];
+			bs = ls[i];
+		}
+	}
+	for (unsigned int i = from; i < nr; i++) {
+		unsigned int k = key[i] ^ flip;
+
+		if (k > bk || (k == bk && seq[i] < bs)) {
+			best = i;
+			bk = k;
+			bs = seq[i];
+		}
+	}
+	return best;
+}
+
+#ifdef __HAVE_X86_SIMD
+__attribute__((target("sse4.1")))
+unsigned int __ready_argbest_sse41(const unsigned int *key, const unsigned int *seq,
+				   unsigned int nr, unsigned int flip)
+{
+	unsigned int lk[4], ls[4], li[4];
+	__m128i vflip = _mm_set1_epi32(flip);
+	__m128i four = _mm_set1_epi32(4);
+	__m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+	__m128i bk, bs, bi;
+	unsigned int i;
+
+	if (nr < 4)
+		return __ready_argbest_scalar(key, seq, nr, flip);
+
+	bk = _mm_xor_si128(_mm_loadu_si128((const __m128i *)key), vflip);
+	bs = _mm_loadu_si128((const __m128i *)seq);
+	bi = idx;
+
+	for (i = 4; i + 4 <= nr; i += 4) {
+		__m128i k = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(key + i)), vflip);
+		__m128i s = _mm_loadu_si128((const __m128i *)(seq + i));
+		__m128i eq = _mm_cmpeq_epi32(k, bk);
+		__m128i gt = _mm_andnot_si128(eq, _mm_cmpeq_epi32(_mm_max_epu32(k, bk), k));
+		__m128i lt = _mm_andnot_si128(_mm_cmpeq_epi32(s, bs),
+					      _mm_cmpeq_epi32(_mm_min_epu32(s, bs), s));
+		__m128i better = _mm_or_si128(gt, _mm_and_si128(eq, lt));
+
+		idx = _mm_add_epi32(idx, four);
+		bk = _mm_blendv_epi8(bk, k, better);
+		bs = _mm_blendv_epi8(bs, s, better);
+		bi = _mm_blendv_epi8(bi, idx, better);
+	}
+
+	_mm_storeu_si128((__m128i *)lk, bk);
+	_mm_storeu_si128((__m128i *)ls, bs);
+	_mm_storeu_si128((__m128i *)li, bi);
+
+	return __argbest_reduce(lk, ls, li, 4, key, seq, i, nr, flip);
+}
+
+__attribute__((target("avx2")))
+unsigned int __ready_argbest_avx2(const unsigned int *key, const unsigned int *seq,
+				  unsigned int nr, unsigned int flip)
+{
+	unsigned int lk[8], ls[8], li[8];
+	__m256i vflip, eight, idx;
+	__m256i bk, bs, bi;
+	unsigned int i;
+
+	/* Before touching the AVX registers, which is costly for a few entries */
+	if (nr < 8)
+		return __ready_argbest_scalar(key, seq, nr, flip);
+
+	vflip = _mm256_set1_epi32(flip);
+	eight = _mm256_set1_epi32(8);
+	idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	bk = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)key), vflip);
+	bs = _mm256_loadu_si256((const __m256i *)seq);
+	bi = idx;
+
+	for (i = 8; i + 8 <= nr; i += 8) {
+		__m256i k = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(key + i)), vflip);
+		__m256i s = _mm256_loadu_si256((const __m256i *)(seq + i));
+		__m256i eq = _mm256_cmpeq_epi32(k, bk);
+		__m256i gt = _mm256_andnot_si256(eq, _mm256_cmpeq_epi32(_mm256_max_epu32(k, bk), k));
+		__m256i lt = _mm256_andnot_si256(_mm256_cmpeq_epi32(s, bs),
+						 _mm256_cmpeq_epi32(_mm256_min_epu32(s, bs), s));
+		__m256i better = _mm256_or_si256(gt, _mm256_and_si256(eq, lt));
+
+		idx = _mm256_add_epi32(idx, eight);
+		bk = _mm256_blendv_epi8(bk, k, better);
+		bs = _mm256_blendv_epi8(bs, s, better);
+		bi = _mm256_blendv_epi8(bi, idx, better);
+	}
+
+	_mm256_storeu_si256((__m256i *)lk, bk);
+	_mm256_storeu_si256((__m256i *)ls, bs);
+	_mm256_storeu_si256((__m256i *)li, bi);
+
+	/* Not inserted by the compiler without optimisation. Avoid the penalty of
+	   the SSE code running with the upper halves of the registers dirty */
+	_mm256_zeroupper();
+
+	return __argbest_reduce(lk, ls, li, 8, key, seq, i, nr, flip);
+}
+#else
+unsigned int __ready_argbest_sse41(const unsigned int *key, const unsigned int *seq,
+				   unsigned int nr, unsigned int flip)
+{
+	return __ready_argbest_scalar(key, seq, nr, flip);
+}
+
+unsigned int __ready_argbest_avx2(const unsigned int *key, const unsigned int *seq,
+				  unsigned int nr, unsigned int flip)
+{
+	return __ready_argbest_scalar(key, seq, nr, flip);
+}
+#endif
+
+static unsigned int __argbest_dispatch(const unsigned int *key, const unsigned int *seq,
+				       unsigned int nr, unsigned int flip);
+
+static unsigned int (*__argbest)(const unsigned int *, const unsigned int *,
+				 unsigned int, unsigned int) = __argbest_dispatch;
+
+/**
+ * Pick the best kernel for this processor
+ */
+static void __argbest_resolve(void)
+{
+	__argbest = __ready_argbest_scalar;
+#ifdef __HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		__argbest = __ready_argbest_avx2;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		__argbest = __ready_argbest_sse41;
+	}
+#endif
+}
+
+/**
+ * Resolve the kernel on the first call
+ */
+static unsigned int __argbest_dispatch(const unsigned int *key, const unsigned int *seq,
+				       unsigned int nr, unsigned int flip)
+{
+	__argbest_resolve();
+	return __argbest(key, seq, nr, flip);
+}
+
+/***********************************************************************
+ * Ready queue operations
+ */
+static void __ready_grow(struct __ready_set *s)
+{
+	s->size = s->size ? s->size * 2 : 256;
+	s->prio = realloc(s->prio, sizeof(*s->prio) * s->size);
+	s->remaining = realloc(s->remaining, sizeof(*s->remaining) * s->size);
+	s->lifespan = realloc(s->lifespan, sizeof(*s->lifespan) * s->size);
+	s->seq = realloc(s->seq, sizeof(*s->seq) * s->size);
+	s->proc = realloc(s->proc, sizeof(*s->proc) * s->size);
+	assert(s->prio && s->remaining && s->lifespan && s->seq && s->proc);
+}
+
+/**
+ * Sequence numbers are running out. Renumber them in the list order
+ */
+static void __ready_renumber(struct __ready_set *s)
+{
+	struct process *p;
+
+	s->next_seq = 0;
+	list_for_each_entry(p, __list_of(s), list) {
+		s->seq[p->cold->__ready_index - 1] = s->next_seq++;
+	}
+}
+
+void ready_enqueue(struct process *p)
+{
+	struct __ready_set *s = __set_of(p);
+	unsigned int i = s->nr;
+
+	assert(!p->cold->__ready_index);
+
+	if (s != __ready && __ready_post) {
+		__ready_post(p);
+		return;
+	}
+
+	if (i == s->size)
+		__ready_grow(s);
+	if (s->next_seq == UINT_MAX)
+		__ready_renumber(s);
+
+	list_add_tail(&p->list, __list_of(s));
+
+	s->prio[i] = p->prio;
+	s->remaining[i] = p->lifespan - p->age;
+	s->lifespan[i] = p->lifespan;
+	s->seq[i] = s->next_seq++;
+	s->proc[i] = p;
+	s->nr++;
+
+	p->cold->__ready_index = i + 1;
+	p->cold->__ready_at = ticks;
+
+	/* Counted by the partitions themselves, which are not grouped */
+	if (__partition_sets)
+		return;
+
+	__nr_ready++;
+	__work_ready += s->remaining[i];
+	if (!__groups[p->cold->__group].nr_ready++ && __grouped)
+		__group_runnable(p->cold->__group);
+}
+
+void ready_dequeue(struct process *p)
+{
+	struct __ready_set *s = __set_of(p);
+	unsigned int i, last, remaining;
+
+	assert(p->cold->__ready_index);
+
+	i = p->cold->__ready_index - 1;
+	last = --s->nr;
+	remaining = s->remaining[i];
+
+	list_del_init(&p->list);
+
+	/* Fill the hole with the last entry */
+	if (i != last) {
+		s->prio[i] = s->prio[last];
+		s->remaining[i] = s->remaining[last];
+		s->lifespan[i] = s->lifespan[last];
+		s->seq[i] = s->seq[last];
+		s->proc[i] = s->proc[last];
+		s->proc[i]->cold->__ready_index = i + 1;
+	}
+	p->cold->__ready_index = 0;
+
+	if (__partition_sets)
+		return;
+
+	__nr_ready--;
+	__work_ready -= remaining;
+	if (!--__groups[p->cold->__group].nr_ready && __grouped)
+		__group_idle(p->cold->__group);
+}
+
+void ready_update(struct process *p)
+{
+	struct __ready_set *s = __set_of(p);
+	unsigned int i = p->cold->__ready_index;
+
+	if (!i)
+		return;
+
+	if (!__partition_sets)
+		__work_ready += (p->lifespan - p->age) - s->remaining[i - 1];
+
+	s->prio[i - 1] = p->prio;
+	s->remaining[i - 1] = p->lifespan - p->age;
+}
+
+void ready_age(void)
+{
+	for (unsigned int i = 0; i < __ready->nr; i++) {
+		__ready->proc[i]->prio = ++__ready->prio[i];
+	}
+}
+
+struct process *ready_highest_prio(void)
+{
+	if (!__ready->nr)
+		return NULL;
+
+	return __ready->proc[__argbest(__ready->prio, __ready->seq, __ready->nr, 0)];
+}
+
+struct process *ready_shortest_remaining(void)
+{
+	if (!__ready->nr)
+		return NULL;
+
+	return __ready->proc[__argbest(__ready->remaining, __ready->seq, __ready->nr, ~0U)];
+}
+
+struct process *ready_shortest_job(void)
+{
+	if (!__ready->nr)
+		return NULL;
+
+	return __ready->proc[__argbest(__ready->lifespan, __ready->seq, __ready->nr, ~0U)];
+}
+
+/***********************************************************************
+ * Ready queue of the groups
+ */
+
+/**
+ * Split the ready processes into the ready sets of their groups, keeping the
+ * order in each group. The default group is scheduled first
+ */
+void __ready_regroup(void)
+{
+	struct process *p, *tmp;
+	LIST_HEAD(ready);
+
+	if (__grouped)
+		return;
+
+	/* The default group is in @readyqueue to begin with */
+	for (unsigned int i = 0; i < MAX_GROUPS; i++) {
+		INIT_LIST_HEAD(&__ready_sets[i].head);
+	}
+
+	list_for_each_entry_safe(p, tmp, &readyqueue, list) {
+		ready_dequeue(p);
+		list_add_tail(&p->list, &ready);
+	}
+
+	__grouped = true;
+	list_for_each_entry_safe(p, tmp, &ready, list) {
+		unsigned int ready_at = p->cold->__ready_at;
+
+		list_del_init(&p->list);
+		ready_enqueue(p);
+		p->cold->__ready_at = ready_at;
+	}
+}
+
+/**
+ * Put the ready queue of group @g into @readyqueue to schedule the group
+ */
+void __ready_switch(unsigned int g)
+{
+	struct __ready_set *s = __ready_sets + g;
+
+	if (!__grouped || s == __ready)
+		return;
+
+	list_splice_init(&readyqueue, &__ready->head);
+	list_splice_init(&s->head, &readyqueue);
+	__ready = s;
+}
+
+/**
+ * # of ready processes in all groups
+ */
+unsigned int __ready_pending(void)
+{
+	return __nr_ready;
+}
+
+/**
+ * Ticks left to run in the ready processes in all groups
+ */
+unsigned long long __ready_work(void)
+{
+	return __work_ready;
+}
+
+/**
+ * Call @fn for each ready process, group by group in the order in the queue
+ */
+void __ready_for_each(void (*fn)(struct process *, void *), void *data)
+{
+	struct process *p;
+
+	for (unsigned int i = 0; i < (__grouped ? MAX_GROUPS : 1); i++) {
+		list_for_each_entry(p, __list_of(__ready_sets + i), list) {
+			fn(p, data);
+		}
+	}
+}
+
+/***********************************************************************
+ * Ready queue of the partitions
+ *
+ * Each partition of the CPUs has its own ready set, which is put into
+ * @readyqueue of the thread simulating the partition. A process getting ready
+ * in another partition is handed to @post instead, so the threads never touch
+ * the sets of the others.
+ */
+void __ready_partition(unsigned int nr, void (*post)(struct process *p))
+{
+	assert(!__nr_ready && !__grouped);
+
+	__partition_sets = calloc(nr, sizeof(*__partition_sets));
+	assert(__partition_sets);
+	for (unsigned int i = 0; i < nr; i++) {
+		INIT_LIST_HEAD(&__partition_sets[i].head);
+	}
+	__ready_post = post;
+
+	/* Not to race on the first call */
+	__argbest_resolve();
+}
+
+/**
+ * Simulate partition @k on this thread
+ */
+void __ready_enter(unsigned int k)
+{
+	struct __ready_set *s = __partition_sets + k;
+
+	assert(list_empty(&readyqueue));
+
+	list_splice_init(&s->head, &readyqueue);
+	__ready = s;
+}
+
+void __ready_leave(void)
+{
+	list_splice_init(&readyqueue, &__ready->head);
+	__ready = __ready_sets;
+}
+
+/**
+ * # of ready processes in partition @k
+ */
+unsigned int __ready_count(unsigned int k)
+{
+	return __partition_sets[k].nr;
+}
+
+/**
+ * Take the process queued last out of partition @k, which is not being
+ * simulated by any thread
+ */
+struct process *__ready_steal(unsigned int k)
+{
+	struct __ready_set *s = __partition_sets + k;
+	struct process *p;
+
+	if (!s->nr)
+		return NULL;
+
+	p = list_last_entry(&s->head, struct process, list);
+	ready_dequeue(p);
+	return p;
+}
@@ -0,0 +1,68 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __READY_H__
+#define __READY_H__
+
+struct process;
+
+/***********************************************************************
+ * Ready queue operations
+ *
+ * DESCRIPTION
+ *   Besides the @readyqueue list, the framework keeps the priority and the
+ *   remaining time of the ready processes in packed arrays, along with the
+ *   sequence numbers telling the order in the list. Put processes into the
+ *   ready queue and take them out only through these functions so that the
+ *   arrays stay in sync with the list. Processes are appended to the tail of
+ *   @readyqueue as list_add_tail() does.
+ */
+void ready_enqueue(struct process *p);
+void ready_dequeue(struct process *p);
+
+/**
+ * Put @p blocked for I/O or for a resource back into the ready queue, and
+ * call back scheduler.woken(). The time from now until @p runs is accounted
+ * as its wake-up latency
+ */
+void ready_wake(struct process *p);
+
+/**
+ * Call after changing the priority of @p. No-op if @p is not ready
+ */
+void ready_update(struct process *p);
+
+/**
+ * Boost the priority of all ready processes by one
+ */
+void ready_age(void);
+
+/***********************************************************************
+ * Pick-next functions
+ *
+ * DESCRIPTION
+ *   Find the ready process with the highest priority, the shortest time to
+ *   complete (lifespan - age), or the shortest lifespan. Among the processes
+ *   with the same key, the one that comes first in @readyqueue is picked.
+ *   The process is not dequeued.
+ *
+ * RETURN
+ *   NULL if the ready queue is empty
+ */
+struct process *ready_highest_prio(void);
+struct process *ready_shortest_remaining(void);
+struct process *ready_shortest_job(void);
+
+#endif
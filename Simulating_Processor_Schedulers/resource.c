@@ -0,0 +1,131 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "simulator.h"
+
+extern struct resource resources[NR_RESOURCES];
+
+bool resource_available(struct resource *r, bool shared)
+{
+	if (!r->nr_owners)
+		return true;
+	if (shared)
+		return r->shared;
+	return !r->shared && r->nr_owners < r->capacity;
+}
+
+void resource_get(struct resource *r, struct process *p, bool shared)
+{
+	assert(resource_available(r, shared));
+
+	if (r->nr_owners == r->__size_owners) {
+		struct process **owners = malloc(sizeof(*owners) * r->__size_owners * 2);
+
+		assert(owners);
+		for (unsigned int i = 0; i < r->nr_owners; i++) {
+			owners[i] = r->owners[i];
+		}
+		if (r->owners != &r->__owner)
+			free(r->owners);
+		r->owners = owners;
+		r->__size_owners *= 2;
+	}
+	r->owners[r->nr_owners++] = p;
+	r->shared = shared;
+}
+
+void resource_put(struct resource *r, struct process *p)
+{
+	unsigned int i = 0;
+
+	while (r->owners[i] != p) {
+		assert(i + 1 < r->nr_owners);
+		i++;
+	}
+	/* Fill the hole with the last owner */
+	r->owners[i] = r->owners[--r->nr_owners];
+
+	if (!r->nr_owners) {
+		r->shared = false;
+		/* Shrink back to the inline slot */
+		if (r->owners != &r->__owner) {
+			free(r->owners);
+			r->owners = &r->__owner;
+			r->__size_owners = 1;
+		}
+	}
+}
+
+bool resource_held_by(struct resource *r, struct process *p)
+{
+	for (unsigned int i = 0; i < r->nr_owners; i++) {
+		if (r->owners[i] == p)
+			return true;
+	}
+	return false;
+}
+
+void resource_wake(struct resource *r, struct process *(*pick)(struct resource *),
+		   void (*wake)(struct process *))
+{
+	struct process *waiter, *p, *tmp;
+	unsigned int slots;
+
+	if (!(waiter = pick(r)))
+		return;
+
+	if (waiter->cold->wants_shared) {
+		list_for_each_entry_safe(p, tmp, &r->waitqueue, list) {
+			if (!p->cold->wants_shared)
+				continue;
+			list_del_init(&p->list);
+			wake(p);
+		}
+		return;
+	}
+
+	/**
+	 * The woken writers take @r only when they run again, so count the
+	 * slots they are woken up for rather than checking @r->nr_owners
+	 */
+	slots = r->capacity - r->nr_owners;
+	do {
+		list_del_init(&waiter->list);
+		wake(waiter);
+	} while (--slots && (waiter = pick(r)) && !waiter->cold->wants_shared);
+}
+
+/**
+ * Make all resources free mutexes
+ */
+void __init_resources(void)
+{
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		struct resource *r = resources + i;
+
+		if (r->owners && r->owners != &r->__owner)
+			free(r->owners);
+		r->owners = &r->__owner;
+		r->__size_owners = 1;
+		r->nr_owners = 0;
+		r->capacity = 1;
+		r->shared = false;
+		INIT_LIST_HEAD(&r->waitqueue);
+		r->ceiling = 0;
+	}
+}
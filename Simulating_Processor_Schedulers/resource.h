@@ -16,6 +16,8 @@
 #ifndef __RESOURCE_H__
 #define __RESOURCE_H__
 
+#include <stdbool.h>
+
 #include "list_head.h"
 
 struct process;
@@ -25,15 +27,42 @@ struct process;
  */
 struct resource {
 	/**
-	 * The owner process of this resource. NULL implies the resource is free
-	 * whereas non-NULL implies @owner process owns this resource
+	 * The processes holding this resource, packed in @owners[0 .. @nr_owners).
+	 * @nr_owners == 0 implies the resource is free. @owners points to
+	 * @__owner while a single process holds the resource, which is the
+	 * common case, and to an array on the heap when more processes share it.
+	 * Use the functions below to take and put the resource
 	 */
-	struct process *owner;
+	struct process **owners;
+	unsigned int nr_owners;
+
+	/**
+	 * # of processes that can hold this resource exclusively at the same time.
+	 * 1 by default, so the resource is a mutex unless the script declares it
+	 * with "resource <id> <capacity>"
+	 */
+	unsigned int capacity;
+
+	/**
+	 * True if the owners share this resource. Any number of processes can
+	 * share a resource, but no one can hold it exclusively meanwhile
+	 */
+	bool shared;
+
+	struct process *__owner;
+	unsigned int __size_owners;
 
 	/**
 	 * list head to list processes that are wanting for the resource
 	 */
 	struct list_head waitqueue;
+
+	/**
+	 * Priority ceiling of this resource, which is the highest original
+	 * priority of the processes that will acquire it. The framework computes
+	 * this from the process script before the simulation starts
+	 */
+	unsigned int ceiling;
 };
 
 /**
@@ -42,4 +71,36 @@ struct resource {
  */
 #define NR_RESOURCES 16
 
+/***********************************************************************
+ * Resource operations
+ *
+ * DESCRIPTION
+ *   resource_available() tells whether a process can take @r in the shared
+ *   mode (@shared) or exclusively right now. resource_get() and
+ *   resource_put() add @p to the owners of @r and remove it, respectively.
+ *   Note that readers are admitted as long as the resource is shared, even
+ *   when a process waits to hold it exclusively.
+ */
+bool resource_available(struct resource *r, bool shared);
+void resource_get(struct resource *r, struct process *p, bool shared);
+void resource_put(struct resource *r, struct process *p);
+bool resource_held_by(struct resource *r, struct process *p);
+
+/***********************************************************************
+ * void resource_wake(struct resource *r,
+ *                    struct process *(*pick)(struct resource *),
+ *                    void (*wake)(struct process *))
+ *
+ * DESCRIPTION
+ *   Take the waiter that @pick chooses among those who can take @r now out
+ *   of the waitqueue of @r, and pass it to @wake, which is supposed to put
+ *   it into the ready queue. If the waiter wants @r shared, all the readers
+ *   in the waitqueue are woken up together in the order they came since
+ *   they can share @r at once. Otherwise, the next waiters @pick chooses are
+ *   woken up as well until the free slots in the capacity of @r run out or
+ *   a reader is chosen. @pick returns NULL if there is no such waiter.
+ */
+void resource_wake(struct resource *r, struct process *(*pick)(struct resource *),
+		   void (*wake)(struct process *));
+
 #endif
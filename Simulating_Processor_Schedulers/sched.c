@@ -20,6 +20,8 @@
 #include <assert.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "list_head.h"
 
@@ -28,21 +30,26 @@
 #include "resource.h"
 
 #include "sched.h"
+#include "ready.h"
+#include "simulator.h"
+#include "loop.h"
 
 /**
- * List head to hold the processes ready to run
+ * List head to hold the processes ready to run. This and the following two
+ * are of the thread simulating them, as the partitions of the CPUs are
+ * simulated in parallel with --partitions. Initialized in __initialize()
  */
-LIST_HEAD(readyqueue);
+__thread struct list_head readyqueue;
 
 /**
  * The process that is currently running
  */
-struct process *current = NULL;
+__thread struct process *current = NULL;
 
 /**
  * Number of generated ticks since the simulator was started
  */
-unsigned int ticks = 0;
+__thread unsigned int ticks = 0;
 
 /**
  * Resources in the system.
@@ -52,17 +59,20 @@ struct resource resources[NR_RESOURCES];
 /**
  * Following code is to maintain the simulator itself.
  */
-struct resource_schedule {
-	unsigned int resource_id;
-	unsigned int at;
-	unsigned int duration;
-	struct list_head list;
-};
-
-static LIST_HEAD(__forkqueue);
+LIST_HEAD(__forkqueue);
 
 bool quiet = false;
 
+__thread struct __stats __stats = { 0 };
+
+__thread bool __need_resched = false;
+
+/**
+ * Checkpoint to save at tick @__checkpoint_at
+ */
+const char *__checkpoint_file = NULL;
+unsigned int __checkpoint_at = 0;
+
 static const char *__process_status_sz[] = {
 	"RDY",
 	"RUN",
@@ -82,33 +92,72 @@ extern struct scheduler pa_scheduler;
 extern struct scheduler pcp_scheduler;
 extern struct scheduler pip_scheduler;
 
-static struct scheduler *sched = &fcfs_scheduler;
+struct scheduler *sched = &fcfs_scheduler;
+
+static struct scheduler *__schedulers[] = {
+	&fcfs_scheduler,
+	&sjf_scheduler,
+	&stcf_scheduler,
+	&rr_scheduler,
+	&prio_scheduler,
+	&pa_scheduler,
+	&pcp_scheduler,
+	&pip_scheduler,
+};
+#define NR_SCHEDULERS	(sizeof(__schedulers) / sizeof(*__schedulers))
+
+/**
+ * Schedulers loaded with --policy
+ */
+#define MAX_PLUGINS	16
+static struct scheduler *__plugins[MAX_PLUGINS];
+static unsigned int __nr_plugins = 0;
+
+/**
+ * Run the generic loop calling back @sched through the function pointers
+ * even if the loop is specialised for @sched
+ */
+static bool __generic_loop = false;
+
+/**
+ * Run the scheduler in each group under the weighted fair share of the groups
+ */
+static bool __grouping = false;
+
+static void __dump_ready(struct process *p, void *data)
+{
+	printf("%2d (%s): %d + %d/%d at %d\n", p->pid, __process_status_sz[p->status],
+	       p->cold->__starts_at, p->age, p->lifespan, p->prio);
+}
 
 void dump_status(void)
 {
 	struct process *p;
 
+	/* Follow the events so far in the terminal */
+	__log_sync();
+
 	printf("***** CURRENT *********\n");
 	if (current) {
 		printf("%2d (%s): %d + %d/%d at %d\n", current->pid,
-		       __process_status_sz[current->status], current->__starts_at, current->age,
+		       __process_status_sz[current->status], current->cold->__starts_at, current->age,
 		       current->lifespan, current->prio);
 	}
 
 	printf("***** READY QUEUE *****\n");
-	list_for_each_entry(p, &readyqueue, list) {
-		printf("%2d (%s): %d + %d/%d at %d\n", p->pid, __process_status_sz[p->status],
-		       p->__starts_at, p->age, p->lifespan, p->prio);
-	}
+	__ready_for_each(__dump_ready, NULL);
 
 	printf("***** RESOURCES *******\n");
 	for (int i = 0; i < NR_RESOURCES; i++) {
 		struct resource *r = resources + i;
 
-		if (r->owner || !list_empty(&r->waitqueue)) {
+		if (r->nr_owners || !list_empty(&r->waitqueue)) {
 			printf("%2d: owned by ", i);
-			if (r->owner) {
-				printf("%d\n", r->owner->pid);
+			if (r->nr_owners) {
+				for (unsigned int j = 0; j < r->nr_owners; j++) {
+					printf("%s%d", j ? ", " : "", r->owners[j]->pid);
+				}
+				printf("%s\n", r->shared ? " (shared)" : "");
 			} else {
 				printf("no one\n");
 			}
@@ -123,280 +172,264 @@ void dump_status(void)
 	return;
 }
 
-#define __print_event(pid, string, args...)   \
-	do {                                      \
-		fprintf(stderr, "%3d: ", ticks);      \
-		for (unsigned int i = 0; i < pid; i++) {       \
-			fprintf(stderr, "    ");          \
-		}                                     \
-		fprintf(stderr, string "\n", ##args); \
-	} while (0);
-
-static inline bool strmatch(char *const str, const char *expect)
-{
-	return (strlen(str) == strlen(expect)) && (strncmp(str, expect, strlen(expect)) == 0);
-}
-
-static void __briefing_schedule(struct process *p)
+/**
+ * Raise the priority ceilings of the resources that @p will acquire
+ */
+static void __raise_prio_ceilings(struct process *p)
 {
 	struct resource_schedule *rs;
 
-	if (quiet)
-		return;
-
-	printf("- Process %d: Forked at tick %d and run for %d tick%s with initial priority %d\n",
-	       p->pid, p->__starts_at, p->lifespan, p->lifespan >= 2 ? "s" : "", p->prio);
+	list_for_each_entry(rs, &p->cold->__resources_to_acquire, list) {
+		struct resource *r = resources + rs->resource_id;
 
-	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
-		printf("    Acquire resource [%d] at %d for %d\n", rs->resource_id, rs->at,
-		       rs->duration);
+		if (r->ceiling < p->prio_orig)
+			r->ceiling = p->prio_orig;
 	}
 }
 
-static int __load_script(char *const filename)
+/**
+ * Compute the priority ceiling of each resource from the processes that will
+ * acquire it
+ */
+static void __set_prio_ceilings(void)
 {
-	char line[MAX_COMMAND_LEN];
-	struct process *p = NULL;
-
-	FILE *file = fopen(filename, "r");
-	while (fgets(line, sizeof(line), file)) {
-		char *tokens[MAX_NR_TOKENS] = { NULL };
-		int nr_tokens = parse_command(line, tokens);
-
-		if (nr_tokens == 0)
-			continue;
-
-		if (strmatch(tokens[0], "process")) {
-			assert(nr_tokens == 2);
-			/* Start processor description */
-			p = malloc(sizeof(*p));
-			memset(p, 0x00, sizeof(*p));
-
-			p->pid = atoi(tokens[1]);
-
-			INIT_LIST_HEAD(&p->list);
-			INIT_LIST_HEAD(&p->__resources_to_acquire);
-			INIT_LIST_HEAD(&p->__resources_holding);
-
-			continue;
-		} else if (strmatch(tokens[0], "end")) {
-			/* End of process description */
-			assert(p);
-
-			list_add_tail(&p->list, &__forkqueue);
-
-			__briefing_schedule(p);
-			p = NULL;
-
-			continue;
-		}
+	struct process *p;
 
-		if (strmatch(tokens[0], "lifespan")) {
-			assert(nr_tokens == 2);
-			p->lifespan = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "prio")) {
-			assert(nr_tokens == 2);
-			p->prio = p->prio_orig = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "start")) {
-			assert(nr_tokens == 2);
-			p->__starts_at = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "acquire")) {
-			struct resource_schedule *rs;
-			assert(nr_tokens == 4);
-
-			rs = malloc(sizeof(*rs));
-
-			*rs = (struct resource_schedule) {
-				.resource_id = atoi(tokens[1]),
-				.at = atoi(tokens[2]),
-				.duration = atoi(tokens[3]),
-			};
-
-			list_add_tail(&rs->list, &p->__resources_to_acquire);
-		} else {
-			fprintf(stderr, "Unknown property %s\n", tokens[0]);
-			return false;
-		}
+	list_for_each_entry(p, &__forkqueue, list) {
+		__raise_prio_ceilings(p);
 	}
-	fclose(file);
-	if (!quiet)
-		printf("\n");
-	return true;
 }
 
 /**
- * Fork process on schedule
+ * Pull processes from the stream up to the first one to be forked after this
+ * tick. The one is kept in @__forkqueue so that the simulation goes on until
+ * the stream is exhausted. In the streaming mode, the priority ceilings are
+ * raised as the processes arrive.
  */
-static int __fork_on_schedule()
+void __fill_from_stream(void)
 {
-	int nr_forked = 0;
-	struct process *p, *tmp;
-	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
-		if (p->__starts_at <= ticks) {
-			list_move_tail(&p->list, &readyqueue);
-			p->status = PROCESS_READY;
-			__print_event(p->pid, "N");
-			if (sched->forked)
-				sched->forked(p);
-			nr_forked++;
+	struct process *p;
+
+	while (__stream_next) {
+		if (!list_empty(&__forkqueue) &&
+		    list_last_entry(&__forkqueue, struct process, list)->cold->__starts_at > ticks)
+			break;
+
+		if (!(p = __stream_next())) {
+			__stream_next = NULL;
+			break;
 		}
+		__raise_prio_ceilings(p);
+		list_add_tail(&p->list, &__forkqueue);
 	}
-	return nr_forked;
 }
 
 /**
- * Exit the process
+ * Start the I/O scheduled at the current age of @p, which blocks @p from
+ * tick @start for the duration of the I/O. Returns false if there is none
  */
-static void __exit_process(struct process *p)
+bool __start_io(struct process *p, unsigned int start)
 {
-	/* Make sure the process is not attached to some list head */
-	assert(list_empty(&p->list));
-
-	/* Make sure the process is not holding any resource */
-	assert(list_empty(&p->__resources_holding));
+	struct io_schedule *io;
 
-	/* Make sure there is no pending resource to acquire */
-	assert(list_empty(&p->__resources_to_acquire));
-
-	if (sched->exiting)
-		sched->exiting(p);
+	list_for_each_entry(io, &p->cold->__io_to_do, list) {
+		if (io->at != p->age || !io->duration)
+			continue;
 
-	__print_event(p->pid, "X");
+		p->status = PROCESS_BLOCKED;
+		p->cold->__io_ticks += io->duration;
+		__timer_add(p, start + io->duration);
+		__log_event(EVENT_IO, p->pid, 0);
 
-	free(p);
+		list_del(&io->list);
+		free(io);
+		return true;
+	}
+	return false;
 }
 
 /**
- * Process resource acqutision
+ * Put @p back to the ready queue on the completion of its I/O
  */
-static bool __run_current_acquire()
+void __complete_io(struct process *p)
 {
-	struct resource_schedule *rs, *tmp;
-
-	list_for_each_entry_safe(rs, tmp, &current->__resources_to_acquire, list) {
-		if (rs->at == current->age) {
-			assert(sched->acquire && "scheduler.acquire() not implemented");
-
-			/* Callback to acquire the resource */
-			if (!sched->acquire(rs->resource_id)) {
-				__print_event(current->pid, "=[%d]", rs->resource_id);
-				return false;
-			}
+	ready_wake(p);
+	__log_event(EVENT_WAKE, p->pid, 0);
+}
 
-			list_move_tail(&rs->list, &current->__resources_holding);
+void ready_wake(struct process *p)
+{
+	assert(p->status == PROCESS_BLOCKED);
 
-			__print_event(current->pid, "+[%d]", rs->resource_id);
-		}
-	}
+	p->status = PROCESS_READY;
+	ready_enqueue(p);
+	p->cold->__woken_at = (__tick_ns ? __now_ns : ticks) + 1;
 
-	return true;
+	/* Ticks are not split, so the preemption only matters with --tick-ns */
+	if (sched->woken && sched->woken(p) && __tick_ns)
+		__need_resched = true;
 }
 
 /**
- * Process resource release
+ * Account the latency from the wake-up of @p to running it now
  */
-static void __run_current_release()
+void __wake_dispatched(struct process *p)
 {
-	struct resource_schedule *rs, *tmp;
-
-	list_for_each_entry_safe(rs, tmp, &current->__resources_holding, list) {
-		if (--rs->duration != 0) {
-			continue;
-		}
-		assert(sched->release && "scheduler.release() not implemented");
+	unsigned long long latency = (__tick_ns ? __now_ns : ticks) - (p->cold->__woken_at - 1);
 
-		/* Callback the release() */
-		sched->release(rs->resource_id);
+	__stats.nr_wakeups++;
+	__stats.wake_latency += latency;
+	if (__stats.max_wake_latency < latency)
+		__stats.max_wake_latency = latency;
 
-		__print_event(current->pid, "-[%d]", rs->resource_id);
+	p->cold->__woken_at = 0;
+}
 
-		list_del(&rs->list);
-		free(rs);
+/**
+ * Run the simulation in the loop specialised for @sched if there is one
+ */
+static void __do_simulation(void)
+{
+	void (*simulate)(void) = NULL;
+
+	if (!__generic_loop)
+		simulate = __specialized_simulation(sched);
+
+	__log_start();
+
+	if (__profiling)
+		__profile_start();
+
+	if (__tick_ns) {
+		__continuous_simulate(sched);
+	} else if (__nr_partitions) {
+		__pdes_simulate(sched);
+	} else if (__nr_cpus > 1) {
+		__smp_simulate(sched);
+	} else if (simulate) {
+		simulate();
+	} else {
+		__simulate(sched);
 	}
+
+	if (__profiling)
+		__profile_stop();
+
+	__log_stop();
 }
 
 /***********************************************************************
- * The main loop for the scheduler simulation
+ * Simulate the loaded script with each of @schedulers and compare them
+ *
+ * Each scheduler runs in a child process forked after loading the script,
+ * so the initial state is cloned by copy-on-write and the schedulers run
+ * in parallel. The children report their statistics through pipes.
  */
-static void __do_simulation(void)
+static int __compare_schedulers(struct scheduler **schedulers, unsigned int nr_schedulers)
 {
-	assert(sched->schedule && "scheduler.schedule() not implemented");
-
-	while (true) {
-		struct process *prev;
+	struct {
+		pid_t pid;
+		int fd;
+		bool done;
+		struct __stats stats;
+	} runs[nr_schedulers];
 
-		/* Fork processes on schedule */
-		__fork_on_schedule();
+	fflush(stdout);
+	fflush(stderr);
 
-		/* Ask scheduler to pick the next process to run */
-		prev = current;
-		current = sched->schedule(); /// 여기서 current 선택
+	for (unsigned int i = 0; i < nr_schedulers; i++) {
+		int fds[2];
 
-		/* If the system has run a process in the previous tick */
-		if (prev) {
-			/* Update the process status */
-			if (prev->status == PROCESS_RUNNING) {
-				prev->status = PROCESS_READY;
-			} /// 전 process ready que 에 넣기
+		if (pipe(fds) < 0) {
+			perror("pipe");
+			return EXIT_FAILURE;
+		}
 
-			/* Decommission it if completed */
-			if (prev->age == prev->lifespan) {
-				prev->status = PROCESS_EXIT;
-				__exit_process(prev); /// 전 process 가 끝났 으면 해당 process 종료
-			}
+		runs[i].fd = fds[0];
+		runs[i].pid = fork();
+		if (runs[i].pid < 0) {
+			perror("fork");
+			return EXIT_FAILURE;
 		}
 
-		/* No process is ready to run at this moment */
-		if (!current) { /// next == NULL
-			/* Quit simulation if no pending process exists */
-			if (list_empty(&readyqueue) && list_empty(&__forkqueue)) {
-				break;
+		if (runs[i].pid == 0) {
+			close(fds[0]);
+			freopen("/dev/null", "w", stdout);
+			freopen("/dev/null", "w", stderr);
+
+			quiet = true;
+			sched = schedulers[i];
+			if (__grouping)
+				sched = __group_sched(sched);
+			if (sched->initialize && sched->initialize()) {
+				_exit(EXIT_FAILURE);
+			}
+			__do_simulation();
+			if (sched->finalize) {
+				sched->finalize();
 			}
 
-			/* Idle temporarily */
-			fprintf(stderr, "%3d: idle\n", ticks);
-		} else { /// next 가 선택 되면
-			/* Execute the current process */
-			current->status = PROCESS_RUNNING;
+			if (write(fds[1], &__stats, sizeof(__stats)) != sizeof(__stats)) {
+				_exit(EXIT_FAILURE);
+			}
+			_exit(EXIT_SUCCESS);
+		}
+		close(fds[1]);
+	}
 
-			/* Ensure that @current is detached from any list */
-			assert(list_empty(&current->list));
+	for (unsigned int i = 0; i < nr_schedulers; i++) {
+		int status;
 
-			/* Try acquiring scheduled resources */
-			if (__run_current_acquire()) {
-				/* Succesfully acquired all the resources to make a progress */
-				__print_event(current->pid, "%d", current->pid);
+		runs[i].done = read(runs[i].fd, &runs[i].stats, sizeof(runs[i].stats)) ==
+				sizeof(runs[i].stats);
+		close(runs[i].fd);
+		waitpid(runs[i].pid, &status, 0);
+		runs[i].done &= WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+	}
 
-				/* So, it ages by one tick */
-				current->age++;
+	if (__tick_ns)
+		printf("Times in ns\n");
+	printf("%-32s %8s %10s %10s %10s %8s %10s %8s\n", "Scheduler", "Ticks",
+	       "Turnaround", "Waiting", "Response", "Max TA", "Dispatches", "Idle");
+	for (unsigned int i = 0; i < nr_schedulers; i++) {
+		struct __stats *st = &runs[i].stats;
+		double nr = st->nr_exited ? st->nr_exited : 1;
 
-				/* And performs scheduled releases */
-				__run_current_release();
-			} else {
-				/**
-				 * The current is blocked while acquiring resource(s).
-				 * In this case, @current could not make a progress in this tick.
-				 * Thus, it does not get aged nor is unable to perform releases
-				 */
-			}
+		if (!runs[i].done) {
+			printf("%-32s %8s\n", schedulers[i]->name, "failed");
+			continue;
 		}
+		printf("%-32s %8llu %10.2f %10.2f %10.2f %8llu %10llu %8llu\n",
+		       schedulers[i]->name, st->ticks, st->turnaround / nr, st->waiting / nr,
+		       st->response / nr, st->max_turnaround, st->nr_dispatches, st->nr_idle);
+	}
+
+	printf("\n%-32s %10s %10s %8s %10s %10s %10s\n", "Scheduler", "Inversion", "Unbounded",
+	       "Starved", "Max ready", "Wake lat", "Max wake");
+	for (unsigned int i = 0; i < nr_schedulers; i++) {
+		struct __stats *st = &runs[i].stats;
+		double nr = st->nr_wakeups ? st->nr_wakeups : 1;
 
-		/* Increase the tick counter */
-		ticks++;
+		if (!runs[i].done)
+			continue;
+		printf("%-32s %10llu %10llu %8llu %10llu %10.2f %10llu\n", schedulers[i]->name,
+		       st->inversion, st->unbounded_inversion, st->nr_starved, st->max_ready_wait,
+		       st->wake_latency / nr, st->max_wake_latency);
 	}
+
+	return EXIT_SUCCESS;
 }
 
 static void __initialize(void)
 {
 	INIT_LIST_HEAD(&readyqueue);
 
-	for (int i = 0; i < NR_RESOURCES; i++) {
-		resources[i].owner = NULL;
-		INIT_LIST_HEAD(&(resources[i].waitqueue));
-	}
+	__init_resources();
 
 	INIT_LIST_HEAD(&__forkqueue);
 
+	__timer_init(0);
+
 	if (quiet)
 		return;
 	printf("               _              _ \n");
@@ -413,16 +446,65 @@ static void __initialize(void)
 	printf("   N: Forked\n");
 	printf("   X: Finished\n");
 	printf("   =: Blocked\n");
+	printf("   I: Blocked for I/O\n");
+	printf("   W: Woken up on I/O completion\n");
+	if (__admission)
+		printf("   R: Rejected on admission\n");
 	printf("  +n: Acquire resource n\n");
 	printf("  -n: Release resource n\n");
+	if (__nr_cpus > 1 || __nr_partitions) {
+		printf(" n@c: Process n runs on CPU c\n");
+		printf("n@c*: Process n warms up the cache of CPU c\n");
+	}
 	printf("\n");
 }
 
 static void __print_usage(char *const name)
 {
-	printf("Usage: %s {-q} -[f|s|S|r|a|p|i] [process script file]\n", name);
+	printf("Usage: %s {-q} {-l} {-P} {-j threads} {-t tick -k checkpoint} -[f|s|S|r|a|p|i] [process script file]\n", name);
+	printf("       %s {-q} {-t tick -k checkpoint} -[f|s|S|r|a|p|i] -R checkpoint\n", name);
 	printf("\n");
-	printf("  -q: Run quietly\n\n");
+	printf("  -q: Run quietly\n");
+	printf("  -l: Report the throughput of loading the script\n");
+	printf("  -j: Parse the script on the threads (default: # of processors)\n");
+	printf("  --sync-log: Write the events on the simulation thread instead of\n");
+	printf("      a dedicated writer thread\n\n");
+	printf("  -t: Save the checkpoint at the tick\n");
+	printf("  -k: Save the checkpoint to the file\n");
+	printf("  -R: Resume from the checkpoint instead of the process script\n\n");
+	printf("  -A, --all-policies: Run all schedulers in parallel and compare them\n");
+	printf("  --policy plugin.so: Use the scheduler in the plugin. Compare the plugins\n");
+	printf("      with -A when given more than once\n");
+	printf("  --generic-loop: Call back the scheduler through the function pointers\n");
+	printf("      instead of the loop specialised for the built-in scheduler\n\n");
+	printf("  --stream: Read the processes from the script as they arrive. Scripts\n");
+	printf("      with repeat, template, ranged pids or expressions are always streamed\n");
+	printf("  --generate type:param=value,...: Generate the processes as they arrive\n");
+	printf("      poisson:rate=0.1,lifespan=5,prio=0-3,workingset=0,count=1000,seed=1,pids=0\n");
+	printf("      onoff:rate=0.1,on=100,off=100,...\n\n");
+	printf("  --contention: Report the contention of each resource after the simulation\n");
+	printf("  --inversion: Report the priority inversion of each process\n");
+	printf("  --starvation ticks: Count a wait in the ready queue longer than the ticks\n\n");
+	printf("  --groups: Share the processor among the groups by their weights, and\n");
+	printf("      run the scheduler below in each group\n\n");
+	printf("  --cpus n: Simulate n CPUs sharing the ready queue\n");
+	printf("  --cache kb: Size of the cache of each CPU (default: %d)\n", CPU_CACHE_SIZE);
+	printf("  --affinity: Place processes on the CPUs where their caches are warm\n");
+	printf("  --partitions n: Split the CPUs into n partitions with their own ready\n");
+	printf("      queues, simulated in parallel\n");
+	printf("  --threads n: Simulate the partitions on the threads (default: # of processors)\n");
+	printf("  --lookahead ticks: Let the partitions run apart up to the ticks while\n");
+	printf("      they do not interact (default: 1)\n\n");
+	printf("  --tick-ns ns: Simulate in continuous time with ticks of the ns. Times in\n");
+	printf("      the script can be fractions of ticks or in ns, us, ms or s\n");
+	printf("  --switch-cost ns: Time to dispatch a process in the continuous time\n\n");
+	printf("  --admit limit=value,...: Reject the processes due to fork beyond the limits\n");
+	printf("      queue=64,deadline=500,rate=0.2,burst=10\n\n");
+	printf("  --timeline file: Write the events with the length of the ready queue and\n");
+	printf("      the # of blocked processes to the file in columns\n\n");
+	printf("  -P: Profile the phases of the simulation and the calls to the scheduler\n");
+	printf("  --profile-stacks file: Write the profile as collapsed stacks for the\n");
+	printf("      flame graph tools to the file. Implies -P\n\n");
 	printf("  -f: Use FCFS scheduler (default)\n");
 	printf("  -s: Use SJF scheduler\n");
 	printf("  -S: Use STCF scheduler\n");
@@ -437,13 +519,168 @@ static void __print_usage(char *const name)
 int main(int argc, char *const argv[])
 {
 	int opt;
-	char *scriptfile;
-
-	while ((opt = getopt(argc, argv, "qfsSrpaich")) != -1) {
+	char *scriptfile = NULL;
+	char *resume_from = NULL;
+	bool checkpoint_at = false;
+	bool all_policies = false;
+	char *generate = NULL;
+	char *timeline = NULL;
+	bool stream = false;
+	enum {
+		OPT_STREAM = 0x100,
+		OPT_GENERATE,
+		OPT_CONTENTION,
+		OPT_INVERSION,
+		OPT_STARVATION,
+		OPT_POLICY,
+		OPT_GENERIC_LOOP,
+		OPT_SYNC_LOG,
+		OPT_GROUPS,
+		OPT_CPUS,
+		OPT_CACHE,
+		OPT_AFFINITY,
+		OPT_PARTITIONS,
+		OPT_THREADS,
+		OPT_LOOKAHEAD,
+		OPT_TICK_NS,
+		OPT_SWITCH_COST,
+		OPT_PROFILE_STACKS,
+		OPT_TIMELINE,
+		OPT_ADMIT,
+	};
+	static const struct option long_options[] = {
+		{ "all-policies", no_argument, NULL, 'A' },
+		{ "stream", no_argument, NULL, OPT_STREAM },
+		{ "generate", required_argument, NULL, OPT_GENERATE },
+		{ "contention", no_argument, NULL, OPT_CONTENTION },
+		{ "inversion", no_argument, NULL, OPT_INVERSION },
+		{ "starvation", required_argument, NULL, OPT_STARVATION },
+		{ "policy", required_argument, NULL, OPT_POLICY },
+		{ "generic-loop", no_argument, NULL, OPT_GENERIC_LOOP },
+		{ "sync-log", no_argument, NULL, OPT_SYNC_LOG },
+		{ "groups", no_argument, NULL, OPT_GROUPS },
+		{ "cpus", required_argument, NULL, OPT_CPUS },
+		{ "cache", required_argument, NULL, OPT_CACHE },
+		{ "affinity", no_argument, NULL, OPT_AFFINITY },
+		{ "partitions", required_argument, NULL, OPT_PARTITIONS },
+		{ "threads", required_argument, NULL, OPT_THREADS },
+		{ "lookahead", required_argument, NULL, OPT_LOOKAHEAD },
+		{ "tick-ns", required_argument, NULL, OPT_TICK_NS },
+		{ "switch-cost", required_argument, NULL, OPT_SWITCH_COST },
+		{ "profile-stacks", required_argument, NULL, OPT_PROFILE_STACKS },
+		{ "timeline", required_argument, NULL, OPT_TIMELINE },
+		{ "admit", required_argument, NULL, OPT_ADMIT },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	while ((opt = getopt_long(argc, argv, "qlj:t:k:R:APfsSrpaich", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'q':
 			quiet = true;
 			break;
+		case 'l':
+			__report_load = true;
+			break;
+		case 'j':
+			__nr_loaders = atoi(optarg);
+			break;
+
+		case 't':
+			__checkpoint_at = atoi(optarg);
+			checkpoint_at = true;
+			break;
+		case 'k':
+			__checkpoint_file = optarg;
+			break;
+		case 'R':
+			resume_from = optarg;
+			break;
+		case 'A':
+			all_policies = true;
+			break;
+		case 'P':
+			__profiling = true;
+			break;
+		case OPT_TIMELINE:
+			timeline = optarg;
+			break;
+		case OPT_ADMIT:
+			if (!__admission_setup(optarg))
+				return EXIT_FAILURE;
+			break;
+		case OPT_PROFILE_STACKS:
+			__profile_stacks = optarg;
+			__profiling = true;
+			break;
+		case OPT_STREAM:
+			stream = true;
+			break;
+		case OPT_GENERATE:
+			generate = optarg;
+			break;
+		case OPT_CONTENTION:
+			__report_contention = true;
+			break;
+		case OPT_INVERSION:
+			__report_inversion = true;
+			break;
+		case OPT_STARVATION:
+			__starvation_ticks = atoi(optarg);
+			break;
+		case OPT_POLICY:
+			if (__nr_plugins == MAX_PLUGINS) {
+				fprintf(stderr, "Too many policies to load\n");
+				return EXIT_FAILURE;
+			}
+			if (!(sched = __load_policy(optarg)))
+				return EXIT_FAILURE;
+			__plugins[__nr_plugins++] = sched;
+			break;
+		case OPT_GENERIC_LOOP:
+			__generic_loop = true;
+			break;
+		case OPT_SYNC_LOG:
+			__sync_log = true;
+			break;
+		case OPT_GROUPS:
+			__grouping = true;
+			break;
+		case OPT_CPUS:
+			__nr_cpus = atoi(optarg);
+			if (__nr_cpus < 1 || __nr_cpus > MAX_CPUS) {
+				fprintf(stderr, "The number of CPUs should be 1 to %d\n", MAX_CPUS);
+				return EXIT_FAILURE;
+			}
+			break;
+		case OPT_CACHE:
+			__cache_size = atoi(optarg);
+			break;
+		case OPT_AFFINITY:
+			__affinity = true;
+			break;
+		case OPT_PARTITIONS:
+			__nr_partitions = atoi(optarg);
+			break;
+		case OPT_THREADS:
+			__nr_threads = atoi(optarg);
+			break;
+		case OPT_LOOKAHEAD:
+			__lookahead = atoi(optarg);
+			if (__lookahead < 1) {
+				fprintf(stderr, "The lookahead should be at least 1 tick\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case OPT_TICK_NS:
+			__tick_ns = strtoull(optarg, NULL, 10);
+			if (__tick_ns < 1) {
+				fprintf(stderr, "A tick should be at least 1 ns\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case OPT_SWITCH_COST:
+			__switch_ns = strtoull(optarg, NULL, 10);
+			break;
 
 		case 'f':
 			sched = &fcfs_scheduler;
@@ -476,28 +713,149 @@ int main(int argc, char *const argv[])
 		}
 	}
 
-	if (optind >= argc) {
+	if ((!resume_from && !generate && optind >= argc) || (!!__checkpoint_file != checkpoint_at)) {
 		__print_usage(argv[0]);
 		return EXIT_FAILURE;
 	}
+	if ((stream || generate) && (resume_from || __checkpoint_file)) {
+		fprintf(stderr, "Checkpoints are not supported in the streaming mode\n");
+		return EXIT_FAILURE;
+	}
+	if (__nr_cpus > 1 && (resume_from || __checkpoint_file)) {
+		fprintf(stderr, "Checkpoints are not supported with several CPUs\n");
+		return EXIT_FAILURE;
+	}
+	if (__nr_partitions > __nr_cpus) {
+		fprintf(stderr, "The number of partitions should be 1 to the number of CPUs\n");
+		return EXIT_FAILURE;
+	}
+	if (__switch_ns && !__tick_ns) {
+		fprintf(stderr, "The switch cost is only for the continuous time with --tick-ns\n");
+		return EXIT_FAILURE;
+	}
+	if (__tick_ns && (resume_from || __checkpoint_file || generate || __grouping ||
+			  __nr_cpus > 1 || __nr_partitions || __report_inversion ||
+			  __starvation_ticks)) {
+		fprintf(stderr, "Checkpoints, generated processes, groups, several CPUs and "
+			"inversion are not supported in the continuous time\n");
+		return EXIT_FAILURE;
+	}
+	if (__nr_partitions && (resume_from || __checkpoint_file || __grouping)) {
+		fprintf(stderr, "Checkpoints and groups are not supported with partitions\n");
+		return EXIT_FAILURE;
+	}
+
+	if (__profiling && (all_policies || __nr_partitions)) {
+		fprintf(stderr, "Profiling is not supported with -A or partitions\n");
+		return EXIT_FAILURE;
+	}
+
+	if (__admission && (all_policies || __nr_partitions || resume_from || __checkpoint_file)) {
+		fprintf(stderr, "Admission control is not supported with -A, partitions or checkpoints\n");
+		return EXIT_FAILURE;
+	}
+	if (timeline && (all_policies || __nr_partitions)) {
+		fprintf(stderr, "The timeline is not supported with -A or partitions\n");
+		return EXIT_FAILURE;
+	}
 
-	scriptfile = argv[optind];
+	if (__grouping)
+		sched = __group_sched(sched);
+	if (__profiling)
+		sched = __profile_sched(sched);
 
 	__initialize();
 
-	if (!__load_script(scriptfile)) {
+	if (resume_from) {
+		if (!__checkpoint_restore(resume_from)) {
+			return EXIT_FAILURE;
+		}
+		if (!quiet)
+			printf("Resumed from tick %d of %s\n\n", ticks, resume_from);
+	} else if (generate) {
+		if (!__stream_generate(generate)) {
+			return EXIT_FAILURE;
+		}
+	} else if (stream) {
+		if (!__stream_script(argv[optind])) {
+			return EXIT_FAILURE;
+		}
+	} else {
+		scriptfile = argv[optind];
+
+		if (!__load_script(scriptfile)) {
+			return EXIT_FAILURE;
+		}
+		if (__stream_next && __checkpoint_file) {
+			fprintf(stderr, "Checkpoints are not supported in the streaming mode\n");
+			return EXIT_FAILURE;
+		}
+
+		__set_prio_ceilings();
+	}
+
+	if ((__nr_partitions || __tick_ns) && __nr_groups > 1) {
+		fprintf(stderr, "Groups are not supported with partitions or in the continuous time\n");
 		return EXIT_FAILURE;
 	}
 
+	if (all_policies) {
+		/* Every child would save the same checkpoint */
+		__checkpoint_file = NULL;
+		if (__nr_plugins)
+			return __compare_schedulers(__plugins, __nr_plugins);
+		return __compare_schedulers(__schedulers, NR_SCHEDULERS);
+	}
+
 	if (sched->initialize && sched->initialize()) {
 		return EXIT_FAILURE;
 	}
 
+	__inversion_start();
+
+	if (timeline && !__timeline_open(timeline)) {
+		return EXIT_FAILURE;
+	}
+
 	__do_simulation();
 
+	if (timeline && !__timeline_close()) {
+		return EXIT_FAILURE;
+	}
+
 	if (sched->finalize) {
 		sched->finalize();
 	}
 
+	__inversion_report();
+
+	if (__nr_groups > 1 || __grouping) {
+		__group_report();
+	}
+
+	if (__nr_cpus > 1 || __nr_partitions) {
+		__smp_report();
+	}
+
+	if (__nr_partitions) {
+		__pdes_report();
+	}
+
+	if (__tick_ns) {
+		__continuous_report();
+	}
+
+	if (__report_contention) {
+		__contention_report();
+	}
+
+	if (__admission) {
+		__admission_report();
+	}
+
+	if (__profiling) {
+		__profile_report();
+	}
+
 	return EXIT_SUCCESS;
 }
@@ -111,6 +111,44 @@ struct scheduler {
 	 *   Callbacked to release the resource @resource_id
 	 */
 	void (*release)(int);
+
+	/***********************************************************************
+	 * bool woken(struct process *process)
+	 *
+	 * DESCRIPTION
+	 *   Called when @process blocked for I/O or for a resource is put back
+	 *   into the ready queue with ready_wake(). You may leave this function
+	 *   NULL if you don't need it.
+	 *
+	 * RETURN
+	 *   true to preempt @current for @process. @schedule() is then called
+	 *   right away instead of at the end of the tick with --tick-ns
+	 *   false to let @current run on
+	 *
+	 *   The return value has no effect in the tick mode without --tick-ns.
+	 *   Ticks are not split, so @schedule() is called at the next tick as
+	 *   usual either way.
+	 */
+	bool (*woken)(struct process *);
 };
 
+
+/***********************************************************************
+ * SCHED_PLUGIN(policy)
+ *
+ * DESCRIPTION
+ *   Export the scheduler @policy from a shared object so that the framework can load
+ *   it with --policy. Build the object with -fPIC -fvisibility=hidden so
+ *   that the policy does not bind to the built-in one of the same name, and
+ *   rebuild it whenever SCHED_PLUGIN_VERSION changes, which is bumped on any
+ *   change of struct scheduler or of the interface to the framework.
+ */
+#define SCHED_PLUGIN_VERSION	4
+
+#define SCHED_PLUGIN(policy) \
+	__attribute__((visibility("default"))) \
+	const unsigned int sched_plugin_version = SCHED_PLUGIN_VERSION; \
+	__attribute__((visibility("default"))) \
+	struct scheduler *sched_plugin = &(policy)
+
 #endif
@@ -0,0 +1,426 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __SIMULATOR_H__
+#define __SIMULATOR_H__
+
+/**
+ * Internals of the simulator shared among the files implementing it.
+ * DO NOT INCLUDE THIS FILE FROM SCHEDULING POLICIES.
+ */
+#include <stdbool.h>
+
+#include "list_head.h"
+#include "process.h"
+#include "resource.h"
+#include "sched.h"
+
+/**
+ * Resource acquisition described with the acquire keyword in the script
+ */
+struct resource_schedule {
+	unsigned int resource_id;
+	unsigned int at;
+	unsigned int duration;
+	bool shared;				/* Acquired with the shared keyword */
+	unsigned int acquired_at;	/* When the resource was acquired */
+	unsigned long long at_ns;	/* @at and @duration in ns with --tick-ns. */
+	unsigned long long duration_ns;
+								/* The age to release at once acquired */
+	struct list_head list;
+};
+
+/**
+ * I/O described with the io keyword in the script. The process is blocked
+ * for @duration ticks after running for @at ticks
+ */
+struct io_schedule {
+	unsigned int at;
+	unsigned int duration;
+	unsigned long long at_ns;	/* In ns with --tick-ns */
+	unsigned long long duration_ns;
+	struct list_head list;
+};
+
+/**
+ * Processes to be forked, in the order of the start time and then in the
+ * order of the script
+ */
+extern struct list_head __forkqueue;
+
+/**
+ * The scheduling policy being simulated
+ */
+extern struct scheduler *sched;
+
+/**
+ * Statistics of the simulation to compare schedulers
+ */
+struct __stats {
+	unsigned long long nr_exited;	/* # of processes exited */
+	unsigned long long turnaround;	/* Sum of ticks from fork to exit */
+	unsigned long long waiting;		/* Sum of ticks not running from fork to exit */
+	unsigned long long response;	/* Sum of ticks from fork to the first run */
+	unsigned long long max_turnaround;
+	unsigned long long nr_dispatches;	/* # of times a process is scheduled in */
+	unsigned long long nr_idle;		/* # of ticks without a process to run */
+	unsigned long long ticks;		/* # of ticks to finish the simulation */
+	unsigned long long inversion;	/* Ticks blocked behind lower-priority owners */
+	unsigned long long unbounded_inversion;
+								/* Ticks blocked while lower-priority processes
+								   outside critical sections ran */
+	unsigned long long nr_starved;	/* # of waits in the ready queue that were too long */
+	unsigned long long max_ready_wait;
+	unsigned long long nr_wakeups;	/* # of processes run after woken up */
+	unsigned long long wake_latency;	/* Sum of ticks from wake-up to the run */
+	unsigned long long max_wake_latency;
+};
+
+extern __thread struct __stats __stats;
+
+/**
+ * loader.c
+ */
+extern bool __report_load;		/* Report the throughput of loading the script */
+extern unsigned int __nr_loaders;	/* # of threads to parse the script. 0 for auto */
+
+struct token;
+
+bool __load_script(const char *filename);
+unsigned int __script_numbers(const struct token *tokens, int nr_tokens);
+
+/**
+ * expand.c. Lines of the script with repeat, template, ranged pids and
+ * expressions expanded as they are read
+ */
+void __expand_open(const char *filename);
+bool __expand_line(struct token *tokens, int *nr_tokens);
+
+/**
+ * Streaming mode. Processes are taken from @__stream_next just before they
+ * are forked instead of being loaded in advance, and are freed on exit.
+ * @__stream_next returns NULL when the stream is exhausted
+ */
+extern struct process *(*__stream_next)(void);
+
+bool __stream_script(const char *filename);		/* loader.c */
+bool __stream_generate(const char *spec);		/* arrival.c */
+
+/**
+ * sched.c. Parts of the simulation loop shared with the specialised loops
+ */
+extern const char *__checkpoint_file;	/* Checkpoint to save at tick @__checkpoint_at */
+extern unsigned int __checkpoint_at;
+
+void __fill_from_stream(void);
+bool __start_io(struct process *p, unsigned int start);
+void __complete_io(struct process *p);
+void __wake_dispatched(struct process *p);
+
+extern __thread bool __need_resched;	/* scheduler.woken() asked to preempt */
+
+/**
+ * policies.c. The simulation loop specialised for @s, or NULL if @s is not
+ * one of the built-in schedulers
+ */
+void (*__specialized_simulation(const struct scheduler *s))(void);
+
+/**
+ * eventlog.c. Events of the simulation written to stderr by a writer thread
+ */
+enum event_type {
+	EVENT_RUN,			/* pid */
+	EVENT_IDLE,			/* idle */
+	EVENT_FORK,			/* N */
+	EVENT_EXIT,			/* X */
+	EVENT_IO,			/* I */
+	EVENT_WAKE,			/* W */
+	EVENT_BLOCKED,		/* =[r] */
+	EVENT_ACQUIRED,		/* +[r] */
+	EVENT_RELEASED,		/* -[r] */
+	EVENT_WARMUP,		/* pid@cpu* */
+	EVENT_REJECTED,		/* R */
+};
+
+extern bool __sync_log;		/* Write the events on the simulation thread */
+
+void __log_event(enum event_type type, unsigned int pid, int arg);
+void __log_sync(void);
+void __log_start(void);
+void __log_stop(void);
+
+struct __log_buffer;	/* Events of a partition, logged in order later */
+
+struct __log_buffer *__log_buffer_alloc(void);
+void __log_buffer_free(struct __log_buffer *b);
+void __log_redirect(struct __log_buffer *b);
+void __log_replay(struct __log_buffer *b, unsigned int until);
+
+/**
+ * admission.c. Admission control of the processes due to fork
+ */
+extern bool __admission;
+
+bool __admission_setup(const char *spec);
+bool __admit(struct process *p);
+void __admission_report(void);
+
+/**
+ * timeline.c. Events of the simulation in a columnar binary file for the
+ * analysis offline
+ */
+extern bool __timeline;
+
+bool __timeline_open(const char *filename);
+bool __timeline_close(void);
+void __timeline_record(unsigned long long at, enum event_type type, unsigned int pid, int arg);
+
+/**
+ * proctab.c
+ */
+struct process *__alloc_process(void);
+void __free_process(struct process *p);
+unsigned int __reserve_processes(unsigned int nr);
+struct process *__init_process(unsigned int slot);
+
+/**
+ * ready.c. Kernels finding the best entry of the ready set, exported for the
+ * benchmark. See the comment on __ready_argbest_scalar()
+ */
+unsigned int __ready_argbest_scalar(const unsigned int *key, const unsigned int *seq,
+				    unsigned int nr, unsigned int flip);
+unsigned int __ready_argbest_sse41(const unsigned int *key, const unsigned int *seq,
+				   unsigned int nr, unsigned int flip);
+unsigned int __ready_argbest_avx2(const unsigned int *key, const unsigned int *seq,
+				  unsigned int nr, unsigned int flip);
+
+/**
+ * ready.c. The ready queue of each group when the groups are scheduled by
+ * their shares. The one of the group being scheduled is in @readyqueue
+ */
+void __ready_regroup(void);
+void __ready_switch(unsigned int g);
+unsigned int __ready_pending(void);
+unsigned long long __ready_work(void);
+void __ready_for_each(void (*fn)(struct process *, void *), void *data);
+
+/**
+ * ready.c. The ready queue of each partition of the CPUs. Processes getting
+ * ready in the other partitions are posted to them with @post
+ */
+void __ready_partition(unsigned int nr, void (*post)(struct process *p));
+void __ready_enter(unsigned int k);
+void __ready_leave(void);
+unsigned int __ready_count(unsigned int k);
+struct process *__ready_steal(unsigned int k);
+
+/**
+ * plugin.c
+ */
+struct scheduler *__load_policy(const char *path);
+
+/**
+ * resource.c
+ */
+void __init_resources(void);
+
+/**
+ * contention.c. Contention profile of each resource. The fields are all
+ * unsigned long long so that checkpoints save them as they do for __stats
+ */
+#define CONTENTION_BUCKETS	33	/* log2 buckets for the values of unsigned int */
+
+struct __contention {
+	unsigned long long nr_acquired;
+	unsigned long long nr_contended;	/* # of acquisitions blocked at first */
+	unsigned long long wait_total;		/* Ticks from the first attempt to acquisition */
+	unsigned long long wait_max;
+	unsigned long long hold_total;		/* Ticks from acquisition to release */
+	unsigned long long hold_max;
+	unsigned long long nr_waiters;		/* # of processes blocked on the resource */
+	unsigned long long peak_waiters;
+	unsigned long long wait_hist[CONTENTION_BUCKETS];
+	unsigned long long hold_hist[CONTENTION_BUCKETS];
+};
+
+extern struct __contention __contention[NR_RESOURCES];
+extern bool __report_contention;
+
+void __contention_blocked(struct process *p, struct resource_schedule *rs);
+void __contention_acquired(struct process *p, struct resource_schedule *rs);
+void __contention_released(struct resource_schedule *rs);
+void __contention_report(void);
+
+/**
+ * inversion.c. Priority inversion and starvation
+ */
+struct __inversion {
+	unsigned long long ran[2][MAX_PRIO + 1];
+								/* Ticks run in ([0]) and out of ([1]) critical
+								   sections per original priority */
+};
+
+extern __thread struct __inversion __inversion;
+extern bool __report_inversion;
+extern unsigned int __starvation_ticks;	/* 0 to disable */
+
+void __inversion_ran(struct process *p);
+void __inversion_blocked(struct process *p);
+void __inversion_acquired(struct process *p);
+void __inversion_dispatched(struct process *p);
+void __inversion_exited(struct process *p);
+void __inversion_start(void);
+void __inversion_report(void);
+
+/**
+ * group.c. Groups of processes sharing the processor by their weights
+ */
+#define MAX_GROUPS			64
+#define GROUP_NAME_LEN		32
+#define GROUP_MAX_WEIGHT	(1U << 20)
+#define GROUP_SHARE_SHIFT	16		/* Fixed point of @entitled */
+
+struct __group {
+	char name[GROUP_NAME_LEN];
+	unsigned int weight;
+	unsigned long long vruntime;	/* Advances by GROUP_MAX_WEIGHT / @weight per tick run */
+	unsigned long long ran;			/* # of ticks run */
+	unsigned long long entitled;	/* Ticks entitled by the weight while runnable */
+
+	unsigned int nr_ready;			/* # of ready processes in the group */
+	unsigned int heap_index;		/* Index in the runnable groups + 1 */
+};
+
+extern struct __group __groups[MAX_GROUPS];
+extern unsigned int __nr_groups;
+extern unsigned long long __group_min_vruntime;
+
+int __group_lookup(const char *name, unsigned int len);
+int __group_declare(const char *name, unsigned int len, unsigned int weight);
+void __group_runnable(unsigned int g);
+void __group_idle(unsigned int g);
+void __group_ran(struct process *p);
+struct scheduler *__group_sched(struct scheduler *inner);
+void __group_report(void);
+
+/**
+ * smp.c. Several CPUs sharing the ready queue. Each CPU has a cache, which
+ * a process warms up by loading its working set as it is dispatched
+ */
+#define MAX_CPUS		1024
+#define CPU_CACHE_SIZE	1024	/* Default KB of the cache of each CPU */
+#define CPU_FILL_RATE	256		/* KB loaded into the cache per tick */
+
+struct __cpu {
+	struct process *curr;		/* Process on the CPU in the previous tick */
+	unsigned long long loaded;	/* KB ever loaded into the cache */
+	unsigned int cold;			/* KB left for @curr to load into the cache */
+	bool pinned;				/* @curr is warming up the cache */
+
+	unsigned long long busy;	/* Ticks running processes */
+	unsigned long long warming;	/* Ticks warming up the cache */
+	unsigned long long idle;
+	unsigned long long nr_migrated;	/* # of processes migrated in */
+	unsigned long long first_kb;	/* KB loaded as processes run first */
+	unsigned long long migrated_kb;	/* KB loaded after migrations */
+	unsigned long long evicted_kb;	/* KB loaded again after preemptions */
+	unsigned long long nr_deferred;	/* # of times left idle for the warm CPU */
+};
+
+extern struct __cpu __cpus[MAX_CPUS];
+extern unsigned int __nr_cpus;
+extern unsigned int __cache_size;
+extern bool __affinity;		/* Place processes on the CPUs they are warm on */
+
+void __smp_place(struct process *next[], unsigned int first, unsigned int nr);
+bool __smp_enter(struct process *p, unsigned int c);
+void __smp_run(const struct scheduler *s, unsigned int c);
+void __smp_simulate(const struct scheduler *s);
+void __smp_report(void);
+
+/**
+ * pdes.c. The CPUs split into partitions simulated in parallel on several
+ * threads. Each partition has its own ready queue
+ */
+extern unsigned int __nr_partitions;	/* 0 unless partitioned */
+extern unsigned int __nr_threads;		/* 0 for the # of online processors */
+extern unsigned int __lookahead;		/* Max ticks the partitions run apart */
+
+void __pdes_simulate(const struct scheduler *s);
+void __pdes_cpus(unsigned int k, unsigned int *first, unsigned int *last);
+void __pdes_report(void);
+
+/**
+ * continuous.c. Simulation in continuous time, in ns, with --tick-ns
+ */
+extern unsigned long long __tick_ns;	/* 0 to simulate tick by tick */
+extern unsigned long long __switch_ns;	/* Cost of dispatching a process */
+extern unsigned long long __now_ns;
+
+void __continuous_simulate(const struct scheduler *s);
+void __continuous_report(void);
+unsigned int __continuous_io_pending(void);
+
+/**
+ * profile.c. Time spent in the phases of the simulation loop and in the
+ * callbacks to the scheduler with -P
+ */
+enum profile_phase {
+	PROFILE_SIMULATE,
+	PROFILE_IO,
+	PROFILE_FORK,
+	PROFILE_ACQUIRE,
+	PROFILE_RELEASE,
+	PROFILE_EXIT,
+	PROFILE_SCHEDULE,
+	PROFILE_FORKED,
+	PROFILE_EXITING,
+	PROFILE_ACQUIRE_CB,
+	PROFILE_RELEASE_CB,
+	PROFILE_WOKEN,
+	NR_PROFILE_PHASES,
+};
+
+extern bool __profiling;
+extern const char *__profile_stacks;	/* File to write the collapsed stacks to */
+
+void __profile_enter(enum profile_phase phase);
+void __profile_leave(enum profile_phase phase);
+struct scheduler *__profile_sched(struct scheduler *inner);
+void __profile_start(void);
+void __profile_stop(void);
+void __profile_report(void);
+
+/* Hooks in the simulation loops, compiled out of the specialised ones in loop.h */
+#define __phase_enter(phase)	do { if (__profiling) __profile_enter(phase); } while (0)
+#define __phase_leave(phase)	do { if (__profiling) __profile_leave(phase); } while (0)
+
+/**
+ * timer.c. Timing wheel for the processes blocked for I/O
+ */
+void __timer_init(unsigned int now);
+void __timer_add(struct process *p, unsigned int expires);
+void __timer_restore(struct process *p, unsigned int expires, unsigned long long seq);
+void __timer_expire(unsigned int now, void (*wake)(struct process *));
+unsigned int __timer_pending(void);
+void __timer_for_each(void (*fn)(struct process *, void *), void *data);
+
+/**
+ * checkpoint.c
+ */
+bool __checkpoint_save(const char *filename);
+bool __checkpoint_restore(const char *filename);
+
+#endif
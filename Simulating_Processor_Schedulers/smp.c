@@ -0,0 +1,377 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "simulator.h"
+#include "ready.h"
+#include "loop.h"
+
+unsigned int __nr_cpus = 1;
+unsigned int __cache_size = CPU_CACHE_SIZE;
+bool __affinity = false;
+
+/**
+ * Simulated CPUs.
+ *
+ * The cache of a CPU is modelled by the KB ever loaded into it in @loaded.
+ * A process dispatched to a CPU loads the part of its working set not in the
+ * cache at CPU_FILL_RATE KB per tick, during which it makes no progress. What
+ * is loaded stays there even if the process is preempted meanwhile. The
+ * process records @loaded in its @__cpu_mark as it runs. Its lines are the
+ * most recently used ones as it leaves the CPU, so they are evicted in the
+ * LRU order only after the others load over the rest of the cache. On the
+ * other CPUs, the whole working set is to be loaded. Working sets larger than
+ * the cache are taken as large as the cache.
+ *
+ * Like a context switch, the warm-up is not preempted. The process keeps the
+ * CPU until it runs a tick after loading its working set, so it makes a
+ * progress even if it is preempted at every tick.
+ *
+ * Each CPU is only touched by the thread simulating it, so the counters are
+ * kept per CPU even for the totals.
+ */
+struct __cpu __cpus[MAX_CPUS];
+
+/**
+ * KB of the working set of @p to load into the cache of CPU @c
+ */
+static unsigned int __cold(struct process *p, unsigned int c)
+{
+	unsigned int ws = p->cold->__working_set;
+	unsigned int resident;
+	unsigned long long since;
+
+	if (ws > __cache_size)
+		ws = __cache_size;
+	if (p->cold->__cpu != c + 1)
+		return ws;
+
+	resident = ws - p->cold->__cpu_missing;
+	since = __cpus[c].loaded - p->cold->__cpu_mark;
+	if (since <= __cache_size - resident)
+		return ws - resident;
+	if (since - (__cache_size - resident) >= resident)
+		return ws;
+	return ws - resident + (since - (__cache_size - resident));
+}
+
+static unsigned int __warmup_ticks(struct process *p, unsigned int c)
+{
+	return (__cold(p, c) + CPU_FILL_RATE - 1) / CPU_FILL_RATE;
+}
+
+/**
+ * Dispatch @p to CPU @c, where it is to load @cpu->cold KB
+ */
+static void __dispatch(struct process *p, unsigned int c)
+{
+	struct __cpu *cpu = __cpus + c;
+	unsigned int cold = __cold(p, c);
+
+	if (!p->cold->__cpu) {
+		cpu->first_kb += cold;
+	} else if (p->cold->__cpu != c + 1) {
+		cpu->nr_migrated++;
+		cpu->migrated_kb += cold;
+	} else {
+		cpu->evicted_kb += cold;
+	}
+
+	cpu->cold = cold;
+	cpu->pinned = cold > 0;
+	p->cold->__cpu = c + 1;
+	p->cold->__cpu_mark = cpu->loaded;
+	p->cold->__cpu_missing = cold;
+}
+
+/**
+ * @p on CPU @c loads a tick worth of its working set into the cache
+ */
+static void __warm_up(struct process *p, unsigned int c)
+{
+	struct __cpu *cpu = __cpus + c;
+	unsigned int kb = cpu->cold < CPU_FILL_RATE ? cpu->cold : CPU_FILL_RATE;
+
+	cpu->cold -= kb;
+	cpu->loaded += kb;
+	p->cold->__cpu_mark = cpu->loaded;
+	p->cold->__cpu_missing -= kb;
+}
+
+/**
+ * Place the processes picked in @next onto the @nr CPUs from @first where
+ * they are the warmest. The processes on the CPUs in the previous tick stay
+ * there. The others take the free CPU that costs the least to warm up, or wait
+ * for the CPU they are warm on when it is expected to free up before they
+ * would warm up the other. The time the CPU running there is expected to take
+ * is its remaining lifespan. The CPU is left idle meanwhile, so the imbalance
+ * is traded for the cost of the migration.
+ */
+void __smp_place(struct process *next[], unsigned int first, unsigned int nr)
+{
+	struct process *placed[MAX_CPUS] = { NULL };
+
+	for (unsigned int i = 0; i < nr; i++) {
+		struct process *p = next[i];
+		unsigned int home = p ? p->cold->__cpu : 0;
+
+		/* Not looking at the CPUs out of the range, simulated elsewhere */
+		if (home && home - 1 >= first && home - 1 < first + nr &&
+		    __cpus[home - 1].curr == p) {
+			placed[home - 1 - first] = p;
+			next[i] = NULL;
+		}
+	}
+
+	for (unsigned int i = 0; i < nr; i++) {
+		struct process *p = next[i];
+		unsigned int best = 0, cost = -1;
+		unsigned int home = p ? p->cold->__cpu : 0;
+
+		if (!p)
+			continue;
+
+		for (unsigned int c = 0; c < nr; c++) {
+			unsigned int t;
+
+			if (placed[c] || (t = __warmup_ticks(p, first + c)) >= cost)
+				continue;
+			best = c;
+			cost = t;
+		}
+
+		if (home && (home - 1 < first || home - 1 >= first + nr))
+			home = 0;
+
+		if (home && home - 1 - first != best && placed[home - 1 - first]) {
+			struct process *q = placed[home - 1 - first];
+			struct __cpu *cpu = __cpus + home - 1;
+			unsigned int wait = q->lifespan - q->age;
+
+			if (q == cpu->curr)
+				wait += (cpu->cold + CPU_FILL_RATE - 1) / CPU_FILL_RATE;
+
+			if (wait + __warmup_ticks(p, home - 1) < cost) {
+				unsigned int ready_at = p->cold->__ready_at;
+
+				ready_enqueue(p);
+				p->cold->__ready_at = ready_at;
+				__cpus[first + best].nr_deferred++;
+				continue;
+			}
+		}
+		placed[best] = p;
+	}
+
+	for (unsigned int i = 0; i < nr; i++) {
+		next[i] = placed[i];
+	}
+}
+
+/**
+ * Put @p on CPU @c for a tick. Returns false if @p is stalled in the tick
+ * until its working set is loaded into the cache
+ */
+bool __smp_enter(struct process *p, unsigned int c)
+{
+	struct __cpu *cpu = __cpus + c;
+
+	if (p != cpu->curr) {
+		__inversion_dispatched(p);
+
+		if (!p->cold->__nr_dispatches)
+			__stats.response += ticks - p->cold->__starts_at;
+		p->cold->__nr_dispatches++;
+		__stats.nr_dispatches++;
+
+		__dispatch(p, c);
+	}
+	if (p->cold->__woken_at)
+		__wake_dispatched(p);
+	cpu->curr = p;
+
+	current = p;
+	current->status = PROCESS_RUNNING;
+
+	/* Ensure that @current is detached from any list */
+	assert(list_empty(&current->list));
+
+	if (cpu->cold) {
+		__warm_up(p, c);
+		cpu->warming++;
+		__log_event(EVENT_WARMUP, current->pid, c + 1);
+		return false;
+	}
+
+	cpu->busy++;
+	cpu->pinned = false;
+	return true;
+}
+
+/**
+ * Run @current on CPU @c for the tick
+ */
+void __smp_run(const struct scheduler *s, unsigned int c)
+{
+	if (__run_current_acquire(s)) {
+		__log_event(EVENT_RUN, current->pid, c + 1);
+
+		current->age++;
+		__inversion_ran(current);
+		__group_ran(current);
+
+		__run_current_release(s);
+
+		if (current->age < current->lifespan)
+			__start_io(current, ticks + 1);
+	}
+}
+
+/***********************************************************************
+ * The main loop for the simulation with @__nr_cpus CPUs
+ *
+ * At each tick, the CPUs ask the scheduler for the next process in turn,
+ * with @current set to the process each of them ran in the previous tick.
+ * So the schedulers work as they are, picking the processes for the CPUs
+ * one by one out of the shared ready queue. The picked processes run on the
+ * CPUs that picked them, or are placed by __smp_place() with @__affinity.
+ */
+void __smp_simulate(const struct scheduler *s)
+{
+	struct process *next[MAX_CPUS];
+
+	assert(s->schedule && "scheduler.schedule() not implemented");
+
+	while (true) {
+		bool running = false;
+
+		/* Wake up the processes completing I/O */
+		__phase_enter(PROFILE_IO);
+		__timer_expire(ticks, __complete_io);
+		__phase_leave(PROFILE_IO);
+
+		/* Fork processes on schedule */
+		__fork_on_schedule(s);
+
+		for (unsigned int i = 0; i < __nr_cpus; i++) {
+			struct process *prev = __cpus[i].curr;
+
+			if (__cpus[i].pinned) {
+				next[i] = prev;
+				continue;
+			}
+
+			/* Woken up by another CPU already, so it is in the ready queue */
+			current = prev && prev->status != PROCESS_READY ? prev : NULL;
+			next[i] = s->schedule();
+
+			if (!prev)
+				continue;
+
+			if (prev->status == PROCESS_RUNNING) {
+				prev->status = PROCESS_READY;
+			} else {
+				/* Blocked, so no longer on the CPU */
+				__cpus[i].curr = NULL;
+			}
+
+			if (prev->age == prev->lifespan) {
+				prev->status = PROCESS_EXIT;
+				__exit_process(s, prev);
+				__cpus[i].curr = NULL;
+			}
+		}
+
+		if (__affinity)
+			__smp_place(next, 0, __nr_cpus);
+
+		for (unsigned int i = 0; i < __nr_cpus; i++) {
+			if (!next[i]) {
+				__cpus[i].curr = NULL;
+				__cpus[i].idle++;
+				continue;
+			}
+			if (__smp_enter(next[i], i))
+				__smp_run(s, i);
+			running = true;
+		}
+		current = NULL;
+
+		if (!running) {
+			/* Quit simulation if no pending process exists */
+			if (!__ready_pending() && list_empty(&__forkqueue) &&
+			    !__timer_pending()) {
+				break;
+			}
+
+			/* Idle temporarily */
+			__log_event(EVENT_IDLE, 0, 0);
+			__stats.nr_idle++;
+		}
+
+		ticks++;
+	}
+
+	__stats.ticks = ticks;
+}
+
+/***********************************************************************
+ * Report the time each CPU spent and the cost of warming up the caches. The
+ * CPUs are summed up for each partition with --partitions
+ */
+void __smp_report(void)
+{
+	unsigned int nr_rows = __nr_partitions ? __nr_partitions : __nr_cpus;
+	int width = __nr_partitions ? 9 : 5;
+	struct __cpu total = { 0 };
+
+	printf("\n%u CPUs with %u KB of cache each, %s placement\n", __nr_cpus, __cache_size,
+	       __affinity ? "affinity-aware" : "naive");
+	printf("%*s %10s %10s %10s %10s\n", width, __nr_partitions ? "Partition" : "CPU",
+	       "Busy", "Warm-up", "Idle", "Migrated");
+	for (unsigned int i = 0; i < nr_rows; i++) {
+		unsigned int first = i, last = i + 1;
+		struct __cpu row = { 0 };
+
+		if (__nr_partitions)
+			__pdes_cpus(i, &first, &last);
+
+		for (unsigned int c = first; c < last; c++) {
+			struct __cpu *cpu = __cpus + c;
+
+			row.busy += cpu->busy;
+			row.warming += cpu->warming;
+			row.idle += cpu->idle;
+			row.nr_migrated += cpu->nr_migrated;
+
+			total.first_kb += cpu->first_kb;
+			total.migrated_kb += cpu->migrated_kb;
+			total.evicted_kb += cpu->evicted_kb;
+			total.nr_deferred += cpu->nr_deferred;
+		}
+		printf("%*u %10llu %10llu %10llu %10llu\n", width, i, row.busy, row.warming,
+		       row.idle, row.nr_migrated);
+		total.warming += row.warming;
+		total.nr_migrated += row.nr_migrated;
+	}
+	printf("%*s %10s %10llu %10s %10llu\n", width, "Total", "", total.warming, "", total.nr_migrated);
+	printf("KB loaded at the first run: %llu, after migration: %llu, after preemption: %llu\n",
+	       total.first_kb, total.migrated_kb, total.evicted_kb);
+	if (__affinity)
+		printf("Waited for the warm CPU: %llu times\n", total.nr_deferred);
+}
@@ -0,0 +1,265 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "simulator.h"
+
+/**
+ * Timeline of the simulation in a columnar binary file with --timeline.
+ *
+ * Every event logged is a row of the columns below. A process running in a
+ * tick is an event, and so is an idle tick, so there is a row for each tick
+ * of each CPU and for each event in between:
+ *
+ *   tick      The tick of the event, or the ns with --tick-ns
+ *   cpu       The CPU of the run and warmup events with several CPUs, else 0
+ *   pid       The process of the event, which is the running one for the run
+ *             events. 0 for the idle ones
+ *   ready     # of the processes in the ready queue
+ *   blocked   # of the processes blocked for I/O or for resources
+ *   event     enum event_type
+ *   resource  The resource of the resource events, else 0
+ *
+ * The columns are encoded as the rows are recorded, each into its own buffer.
+ * The values of a column are in runs of the same value, each of which is the
+ * value followed by the length of the run. The tick column is in runs of the
+ * same difference from the previous tick instead, so the ticks in a row go in
+ * a run. The values, the differences in zigzag, and the lengths are varints
+ * of 7 bits per byte, the least significant first, with the high bit set on
+ * all bytes but the last. So long stretches of the same process running or
+ * of idle ticks take a few bytes in each column.
+ *
+ * The file is written in the byte order of the host, and is laid out to be
+ * mmapped as is:
+ *
+ *   struct timeline_header         Magic, version, # of rows and columns
+ *   struct timeline_column[]       Name, encoding, offset and size of each
+ *   columns                        Each at an offset aligned to 64 bytes
+ */
+#define TIMELINE_MAGIC		"SCHEDTL"
+#define TIMELINE_VERSION	1
+#define TIMELINE_ALIGN		64
+
+enum timeline_encoding {
+	TIMELINE_RLE = 1,		/* Runs of (value, length) */
+	TIMELINE_DELTA_RLE,		/* Runs of (zigzag difference, length) */
+};
+
+struct timeline_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int nr_columns;
+	unsigned long long nr_rows;
+};
+
+struct timeline_column {
+	char name[16];
+	unsigned int encoding;
+	unsigned int __pad;
+	unsigned long long offset;		/* From the start of the file */
+	unsigned long long size;		/* In bytes */
+};
+
+enum {
+	COLUMN_TICK,
+	COLUMN_CPU,
+	COLUMN_PID,
+	COLUMN_READY,
+	COLUMN_BLOCKED,
+	COLUMN_EVENT,
+	COLUMN_RESOURCE,
+	NR_COLUMNS,
+};
+
+static struct __column {
+	const char *name;
+	enum timeline_encoding encoding;
+	unsigned char *buffer;
+	size_t len;
+	size_t size;
+	unsigned long long prev;	/* Previous value for TIMELINE_DELTA_RLE */
+	unsigned long long value;	/* Value of the current run */
+	unsigned long long run;		/* Length of the current run */
+} __columns[NR_COLUMNS] = {
+	[COLUMN_TICK] = { "tick", TIMELINE_DELTA_RLE },
+	[COLUMN_CPU] = { "cpu", TIMELINE_RLE },
+	[COLUMN_PID] = { "pid", TIMELINE_RLE },
+	[COLUMN_READY] = { "ready", TIMELINE_RLE },
+	[COLUMN_BLOCKED] = { "blocked", TIMELINE_RLE },
+	[COLUMN_EVENT] = { "event", TIMELINE_RLE },
+	[COLUMN_RESOURCE] = { "resource", TIMELINE_RLE },
+};
+
+bool __timeline = false;
+static FILE *__timeline_file = NULL;
+static const char *__timeline_name = NULL;
+static unsigned long long __nr_rows = 0;
+
+static void __put_varint(struct __column *c, unsigned long long v)
+{
+	if (c->len + 10 > c->size) {
+		c->size = c->size ? c->size * 2 : 4096;
+		c->buffer = realloc(c->buffer, c->size);
+		assert(c->buffer);
+	}
+
+	while (v >= 0x80) {
+		c->buffer[c->len++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	c->buffer[c->len++] = v;
+}
+
+static void __end_run(struct __column *c)
+{
+	if (!c->run)
+		return;
+	__put_varint(c, c->value);
+	__put_varint(c, c->run);
+	c->run = 0;
+}
+
+static void __append(struct __column *c, unsigned long long v)
+{
+	if (c->encoding == TIMELINE_DELTA_RLE) {
+		long long delta = v - c->prev;
+
+		c->prev = v;
+		v = ((unsigned long long)delta << 1) ^ (delta >> 63);
+	}
+
+	if (c->run && c->value == v) {
+		c->run++;
+		return;
+	}
+	__end_run(c);
+	c->value = v;
+	c->run = 1;
+}
+
+/**
+ * # of the processes waiting for I/O or for resources
+ */
+static unsigned int __blocked(void)
+{
+	unsigned int nr = __timer_pending() + __continuous_io_pending();
+
+	for (int i = 0; i < NR_RESOURCES; i++) {
+		nr += __contention[i].nr_waiters;
+	}
+	return nr;
+}
+
+/**
+ * Record the event logged at @at as a row. See __log_event()
+ */
+void __timeline_record(unsigned long long at, enum event_type type, unsigned int pid, int arg)
+{
+	bool on_cpu = type == EVENT_RUN || type == EVENT_WARMUP;
+	bool on_resource = type == EVENT_BLOCKED || type == EVENT_ACQUIRED ||
+			   type == EVENT_RELEASED;
+
+	__append(__columns + COLUMN_TICK, at);
+	__append(__columns + COLUMN_CPU, on_cpu && arg ? arg - 1 : 0);
+	__append(__columns + COLUMN_PID, pid);
+	__append(__columns + COLUMN_READY, __ready_pending());
+	__append(__columns + COLUMN_BLOCKED, __blocked());
+	__append(__columns + COLUMN_EVENT, type);
+	__append(__columns + COLUMN_RESOURCE, on_resource ? arg : 0);
+	__nr_rows++;
+}
+
+/**
+ * Open @filename to write the timeline to. Opened before the simulation so
+ * that it does not fail after a long run
+ */
+bool __timeline_open(const char *filename)
+{
+	if (!(__timeline_file = fopen(filename, "wb"))) {
+		perror(filename);
+		return false;
+	}
+	__timeline_name = filename;
+	__timeline = true;
+	return true;
+}
+
+static unsigned long long __align(unsigned long long offset)
+{
+	return (offset + TIMELINE_ALIGN - 1) & ~(unsigned long long)(TIMELINE_ALIGN - 1);
+}
+
+/**
+ * Write out the rows recorded so far and close the file
+ */
+bool __timeline_close(void)
+{
+	static const char zeros[TIMELINE_ALIGN] = { 0 };
+	struct timeline_header header = {
+		.magic = TIMELINE_MAGIC,
+		.version = TIMELINE_VERSION,
+		.nr_columns = NR_COLUMNS,
+		.nr_rows = __nr_rows,
+	};
+	struct timeline_column directory[NR_COLUMNS];
+	unsigned long long offset = __align(sizeof(header) + sizeof(directory));
+	unsigned long long written = 0;
+	bool ok;
+
+	if (!__timeline_file)
+		return true;
+
+	memset(directory, 0, sizeof(directory));
+	for (int i = 0; i < NR_COLUMNS; i++) {
+		struct __column *c = __columns + i;
+
+		__end_run(c);
+		strncpy(directory[i].name, c->name, sizeof(directory[i].name) - 1);
+		directory[i].encoding = c->encoding;
+		directory[i].offset = offset;
+		directory[i].size = c->len;
+		offset = __align(offset + c->len);
+	}
+
+	fwrite(&header, sizeof(header), 1, __timeline_file);
+	fwrite(directory, sizeof(directory), 1, __timeline_file);
+	written = sizeof(header) + sizeof(directory);
+
+	for (int i = 0; i < NR_COLUMNS; i++) {
+		struct __column *c = __columns + i;
+
+		fwrite(zeros, 1, directory[i].offset - written, __timeline_file);
+		fwrite(c->buffer, 1, c->len, __timeline_file);
+		written = directory[i].offset + c->len;
+
+		free(c->buffer);
+		c->buffer = NULL;
+		c->len = c->size = 0;
+	}
+
+	ok = !ferror(__timeline_file);
+	if (fclose(__timeline_file) || !ok) {
+		perror(__timeline_name);
+		ok = false;
+	}
+	__timeline_file = NULL;
+	__timeline = false;
+	return ok;
+}
@@ -0,0 +1,172 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "simulator.h"
+
+/**
+ * Hierarchical timing wheel holding the processes blocked for I/O.
+ *
+ * Level l has WHEEL_SIZE slots of WHEEL_SIZE^l ticks each. A process is put
+ * into the lowest level that covers its expiry, indexed by the digit of the
+ * expiry at the level, and linked through its @list. When the lower digits
+ * of the tick wrap around, the slot of the upper level is cascaded down.
+ * Expiries beyond the highest level wait in @overflow. So adding a process
+ * and waking it up are O(1), and each process is cascaded at most
+ * WHEEL_LEVELS times.
+ */
+#define WHEEL_BITS		6
+#define WHEEL_SIZE		(1U << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+
+static struct {
+	struct list_head slots[WHEEL_LEVELS][WHEEL_SIZE];
+	struct list_head overflow;
+	unsigned int now;
+	unsigned int nr;
+	unsigned long long next_seq;
+} __wheel;
+
+void __timer_init(unsigned int now)
+{
+	for (int l = 0; l < WHEEL_LEVELS; l++) {
+		for (unsigned int i = 0; i < WHEEL_SIZE; i++) {
+			INIT_LIST_HEAD(&__wheel.slots[l][i]);
+		}
+	}
+	INIT_LIST_HEAD(&__wheel.overflow);
+	__wheel.now = now;
+	__wheel.nr = 0;
+}
+
+static void __timer_insert(struct process *p)
+{
+	unsigned int expires = p->cold->__io_until;
+	unsigned int delta = expires - __wheel.now;
+
+	for (int l = 0; l < WHEEL_LEVELS; l++) {
+		if (delta < 1U << (WHEEL_BITS * (l + 1))) {
+			list_add_tail(&p->list, &__wheel.slots[l][(expires >> (WHEEL_BITS * l)) & WHEEL_MASK]);
+			return;
+		}
+	}
+	list_add_tail(&p->list, &__wheel.overflow);
+}
+
+/**
+ * Block @p until tick @expires, which should not be in the past
+ */
+void __timer_add(struct process *p, unsigned int expires)
+{
+	assert(list_empty(&p->list));
+	assert(expires >= __wheel.now);
+
+	p->cold->__io_until = expires;
+	p->cold->__io_seq = __wheel.next_seq++;
+	__timer_insert(p);
+	__wheel.nr++;
+}
+
+/**
+ * Restore a process saved in a checkpoint with its sequence number
+ */
+void __timer_restore(struct process *p, unsigned int expires, unsigned long long seq)
+{
+	__timer_add(p, expires);
+	p->cold->__io_seq = seq;
+	if (__wheel.next_seq <= seq)
+		__wheel.next_seq = seq + 1;
+}
+
+static void __cascade(struct list_head *slot)
+{
+	struct process *p, *tmp;
+
+	list_for_each_entry_safe(p, tmp, slot, list) {
+		list_del_init(&p->list);
+		__timer_insert(p);
+	}
+}
+
+/**
+ * Advance the wheel to tick @now and call @wake for the processes whose I/O
+ * completes at the tick. They are woken up in the order they started I/O so
+ * that the order does not depend on how they went through the wheel.
+ */
+void __timer_expire(unsigned int now, void (*wake)(struct process *))
+{
+	struct list_head *slot;
+	struct process *p, *tmp;
+	LIST_HEAD(expired);
+
+	__wheel.now = now;
+	if (!__wheel.nr)
+		return;
+
+	if (!(now & ((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)))
+		__cascade(&__wheel.overflow);
+	for (int l = WHEEL_LEVELS - 1; l > 0; l--) {
+		if (!(now & ((1U << (WHEEL_BITS * l)) - 1)))
+			__cascade(&__wheel.slots[l][(now >> (WHEEL_BITS * l)) & WHEEL_MASK]);
+	}
+
+	slot = &__wheel.slots[0][now & WHEEL_MASK];
+	list_for_each_entry_safe(p, tmp, slot, list) {
+		struct process *pos;
+
+		assert(p->cold->__io_until == now);
+		list_del_init(&p->list);
+
+		/* Usually in order already. Otherwise, insert in place */
+		list_for_each_entry_reverse(pos, &expired, list) {
+			if (pos->cold->__io_seq < p->cold->__io_seq)
+				break;
+		}
+		list_add(&p->list, &pos->list);
+		__wheel.nr--;
+	}
+
+	list_for_each_entry_safe(p, tmp, &expired, list) {
+		list_del_init(&p->list);
+		wake(p);
+	}
+}
+
+unsigned int __timer_pending(void)
+{
+	return __wheel.nr;
+}
+
+/**
+ * Call @fn for each process in the wheel
+ */
+void __timer_for_each(void (*fn)(struct process *, void *), void *data)
+{
+	struct process *p;
+
+	for (int l = 0; l < WHEEL_LEVELS; l++) {
+		for (unsigned int i = 0; i < WHEEL_SIZE; i++) {
+			list_for_each_entry(p, &__wheel.slots[l][i], list) {
+				fn(p, data);
+			}
+		}
+	}
+	list_for_each_entry(p, &__wheel.overflow, list) {
+		fn(p, data);
+	}
+}